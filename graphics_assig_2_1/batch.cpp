@@ -0,0 +1,312 @@
+#include "batch.h"
+#include "boundedqueue.h"
+#include "filters.h"
+#include <stb/stb_image_write.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const int JPEG_QUALITY = 90;
+
+static string LowerExtension(const string &name)
+{
+	size_t dot = name.rfind('.');
+	if (dot == string::npos) return "";
+	string extension = name.substr(dot + 1);
+	for (char &c : extension) c = (char)tolower((unsigned char)c);
+	return extension;
+}
+
+static bool IsJpegExtension(const string &extension)
+{
+	return extension == "jpg" || extension == "jpeg";
+}
+
+// the formats stb_image reads
+static bool IsImageName(const string &name)
+{
+	static const char *extensions[] = { "png", "jpg", "jpeg", "bmp", "tga", "gif", "psd", "hdr", "pic", "ppm", "pgm" };
+	string extension = LowerExtension(name);
+	for (const char *known : extensions) {
+		if (extension == known) return true;
+	}
+	return false;
+}
+
+// the image files in a directory, sorted by name
+static bool ListImages(const string &directory, vector<string> *names)
+{
+	DIR *dir = opendir(directory.c_str());
+	if (!dir) {
+		cout << "Could not open " << directory << endl;
+		return false;
+	}
+	while (dirent *entry = readdir(dir)) {
+		string name = entry->d_name;
+		struct stat info;
+		if (IsImageName(name) && stat((directory + "/" + name).c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+			names->push_back(name);
+		}
+	}
+	closedir(dir);
+	sort(names->begin(), names->end());
+	return true;
+}
+
+// the output name: the input's for JPEGs, with a .png extension otherwise
+static string OutputName(const string &name)
+{
+	if (IsJpegExtension(LowerExtension(name))) return name;
+	size_t dot = name.rfind('.');
+	return name.substr(0, dot) + ".png";
+}
+
+// RGBA if any pixel is not opaque, RGB otherwise (JPEGs are always RGB)
+static int OutputComponents(const MyImage &image, bool jpeg)
+{
+	if (jpeg) return 3;
+	for (size_t i = 3; i < image.pixels.size(); i += 4) {
+		if (image.pixels[i] < 1.0f) return 4;
+	}
+	return 3;
+}
+
+bool WriteImage(const MyImage &image, const string &path, vector<unsigned char> *bytes)
+{
+	bool jpeg = IsJpegExtension(LowerExtension(path));
+	int components = OutputComponents(image, jpeg);
+	StoreImage(image, bytes, components);
+
+	if (jpeg) {
+		return stbi_write_jpg(path.c_str(), image.width, image.height, components, bytes->data(), JPEG_QUALITY) != 0;
+	}
+	return stbi_write_png(path.c_str(), image.width, image.height, components, bytes->data(), image.width * components) != 0;
+}
+
+// --------------------------------------------------------------------------
+// The pipeline
+
+// an image on its way through the stages; the buffers are reused by the
+// next image the job carries, so once they have grown to the largest image
+// filtering allocates nothing and starts no threads (see ParallelRows()).
+// Decoding and encoding still allocate inside stb_image and libpng.
+struct BatchJob
+{
+	size_t index;		// into the list of names
+	bool decoded;
+	bool written;
+	MyImage source;
+	MyImage filtered;
+	FilterScratch scratch;		// the filter's intermediate passes
+	vector<unsigned char> bytes;
+
+	// initialize to a job not carrying an image
+	BatchJob() : index(0), decoded(false), written(false) {}
+};
+
+typedef BoundedQueue<BatchJob *> JobQueue;
+
+// time the workers of a stage spent working and waiting, in nanoseconds
+struct StageStats
+{
+	const char *name;
+	int workers;
+	atomic<uint64_t> busy;
+	atomic<uint64_t> starved;	// waiting for an image to work on
+	atomic<uint64_t> blocked;	// waiting for room in the next queue
+
+	// initialize to no time spent
+	StageStats(const char *name, int workers) : name(name), workers(workers), busy(0), starved(0), blocked(0) {}
+};
+
+static uint64_t ElapsedNs(chrono::steady_clock::time_point start)
+{
+	return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+// spins briefly, then sleeps, so a stage waiting long leaves its core to
+// the others
+static void Backoff(int *tries)
+{
+	if (++*tries < 64) {
+		this_thread::yield();
+	} else {
+		this_thread::sleep_for(chrono::microseconds(50));
+	}
+}
+
+static BatchJob *PopJob(JobQueue *queue, StageStats *stats)
+{
+	auto start = chrono::steady_clock::now();
+	BatchJob *job = nullptr;
+	for (int tries = 0; !TryPop(queue, &job); ) Backoff(&tries);
+	stats->starved += ElapsedNs(start);
+	return job;
+}
+
+static void PushJob(JobQueue *queue, BatchJob *job, StageStats *stats)
+{
+	auto start = chrono::steady_clock::now();
+	for (int tries = 0; !TryPush(queue, job); ) Backoff(&tries);
+	stats->blocked += ElapsedNs(start);
+}
+
+BatchStages::BatchStages() : decoders(0), filterers(0), encoders(0), queueDepth(4)
+	{}
+
+// fills in the automatic worker counts: a quarter of the hardware threads
+// each for decoding and encoding, the rest for filtering
+static BatchStages ResolveStages(const BatchStages &stages, size_t images)
+{
+	int threads = (int)max(1u, thread::hardware_concurrency());
+	BatchStages resolved = stages;
+	if (resolved.decoders <= 0) resolved.decoders = max(threads / 4, 1);
+	if (resolved.encoders <= 0) resolved.encoders = max(threads / 4, 1);
+	if (resolved.filterers <= 0) resolved.filterers = max(threads - resolved.decoders - resolved.encoders, 1);
+	resolved.decoders = min(resolved.decoders, (int)images);
+	resolved.filterers = min(resolved.filterers, (int)images);
+	resolved.encoders = min(resolved.encoders, (int)images);
+	resolved.queueDepth = max(resolved.queueDepth, 1);
+	return resolved;
+}
+
+static void PrintStageStats(const vector<StageStats *> &stats, double seconds)
+{
+	const StageStats *bottleneck = nullptr;
+	double busiest = -1;
+	for (const StageStats *stage : stats) {
+		double available = seconds * 1e9 * stage->workers;
+		double busy = stage->busy / available;
+		cout << "  " << left << setw(8) << stage->name << right << setw(3) << stage->workers << " workers  busy "
+			 << fixed << setprecision(0) << setw(3) << busy * 100 << "%  waiting for input " << setw(3)
+			 << stage->starved / available * 100 << "%  waiting for output " << setw(3)
+			 << stage->blocked / available * 100 << "%" << endl;
+		if (busy > busiest) {
+			busiest = busy;
+			bottleneck = stage;
+		}
+	}
+	if (bottleneck) cout << "  the busiest stage is " << bottleneck->name << endl;
+}
+
+int RunBatch(const char *inputDirectory, char effectKey, const char *outputDirectory, const BatchStages &requested)
+{
+	FilterParams params;
+	if (!FilterPreset(effectKey, &params)) {
+		cout << "Unknown effect " << effectKey << ", use one of Z X C V B S A D L K J H G" << endl;
+		return 1;
+	}
+
+	vector<string> names;
+	if (!ListImages(inputDirectory, &names)) return 1;
+	if (names.empty()) {
+		cout << "No images in " << inputDirectory << endl;
+		return 1;
+	}
+	if (mkdir(outputDirectory, 0755) != 0 && errno != EEXIST) {
+		cout << "Could not create " << outputDirectory << endl;
+		return 1;
+	}
+
+	BatchStages stages = ResolveStages(requested, names.size());
+	cout << "Applying " << FilterPresetName(effectKey) << " to " << names.size() << " images in " << inputDirectory
+		 << " with " << stages.decoders << " decoders, " << stages.filterers << " filterers and "
+		 << stages.encoders << " encoders" << endl;
+
+	// enough jobs for every worker to hold one and every queue to be full;
+	// the free queue hands them back to the decoders once written
+	size_t jobCount = stages.decoders + stages.filterers + stages.encoders + 2 * stages.queueDepth;
+	vector<BatchJob> jobs(jobCount);
+	JobQueue freeJobs(jobCount), decoded(stages.queueDepth), filtered(stages.queueDepth);
+	for (BatchJob &job : jobs) TryPush(&freeJobs, &job);
+
+	// filter workers share the hardware threads left over as row bands
+	int threads = (int)max(1u, thread::hardware_concurrency());
+	int bands = max((threads - stages.decoders - stages.encoders) / stages.filterers, 1);
+
+	// rows are stored bottom first, files are written top first
+	stbi_flip_vertically_on_write(1);
+
+	StageStats decodeStats("decode", stages.decoders);
+	StageStats filterStats("filter", stages.filterers);
+	StageStats encodeStats("encode", stages.encoders);
+
+	// every stage handles each image once, failed ones included, so a worker
+	// stops once its stage has claimed them all
+	atomic<size_t> decodeClaimed(0), filterClaimed(0), encodeClaimed(0);
+	atomic<unsigned> failed(0);
+	atomic<uint64_t> pixelCount(0);
+	mutex logMutex;
+	auto start = chrono::steady_clock::now();
+
+	auto decode = [&]() {
+		for (size_t i = decodeClaimed++; i < names.size(); i = decodeClaimed++) {
+			BatchJob *job = PopJob(&freeJobs, &decodeStats);
+			auto busyStart = chrono::steady_clock::now();
+			job->index = i;
+			job->decoded = LoadImage(&job->source, (string(inputDirectory) + "/" + names[i]).c_str());
+			decodeStats.busy += ElapsedNs(busyStart);
+			PushJob(&decoded, job, &decodeStats);
+		}
+	};
+	auto filter = [&]() {
+		LimitParallelRows(bands);
+		while (filterClaimed++ < names.size()) {
+			BatchJob *job = PopJob(&decoded, &filterStats);
+			auto busyStart = chrono::steady_clock::now();
+			if (job->decoded) ApplyFilter(job->source, &job->filtered, params, &job->scratch);
+			filterStats.busy += ElapsedNs(busyStart);
+			PushJob(&filtered, job, &filterStats);
+		}
+	};
+	auto encode = [&]() {
+		while (encodeClaimed++ < names.size()) {
+			BatchJob *job = PopJob(&filtered, &encodeStats);
+			auto busyStart = chrono::steady_clock::now();
+			string output = string(outputDirectory) + "/" + OutputName(names[job->index]);
+			job->written = job->decoded && WriteImage(job->filtered, output, &job->bytes);
+			encodeStats.busy += ElapsedNs(busyStart);
+
+			{
+				lock_guard<mutex> lock(logMutex);
+				if (job->written) {
+					pixelCount += (uint64_t)job->filtered.width * job->filtered.height;
+					cout << "  " << output << " (" << job->filtered.width << " x " << job->filtered.height << ")" << endl;
+				} else {
+					failed++;
+					cout << "  Could not process " << inputDirectory << "/" << names[job->index] << endl;
+				}
+			}
+			PushJob(&freeJobs, job, &encodeStats);
+		}
+	};
+
+	vector<thread> pool;
+	for (int i = 0; i < stages.decoders; i++) pool.emplace_back(decode);
+	for (int i = 0; i < stages.filterers; i++) pool.emplace_back(filter);
+	for (int i = 0; i < stages.encoders; i++) pool.emplace_back(encode);
+	for (thread &worker : pool) worker.join();
+
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+	double seconds = max(elapsed.count(), 1e-9);
+	unsigned processed = (unsigned)names.size() - failed;
+	cout << processed << " images, " << fixed << setprecision(2) << pixelCount / 1e6 << " Mpix in "
+		 << seconds << " s: " << setprecision(1) << processed / seconds << " images/s, "
+		 << pixelCount / 1e6 / seconds << " Mpix/s" << endl;
+	PrintStageStats({ &decodeStats, &filterStats, &encodeStats }, seconds);
+	if (failed > 0) cout << failed << " images failed" << endl;
+	return failed > 0 ? 1 : 0;
+}
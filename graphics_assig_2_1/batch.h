@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "filters.h"
+
+// --------------------------------------------------------------------------
+// Headless batch processing with the CPU filter engine (no window or GPU
+// required): every image in a directory is filtered with one of the effect
+// keys and written to another directory under the same name. JPEGs are
+// written as JPEGs; everything else as PNG.
+
+// threads per stage of the pipeline; 0 picks a share of the hardware threads
+struct BatchStages
+{
+	int decoders;
+	int filterers;
+	int encoders;
+	int queueDepth;		// images waiting between two stages at most
+
+	// initialize to the automatic choice with four images per queue
+	BatchStages();
+};
+
+// filters the images of inputDirectory with the preset of effectKey (see
+// FilterPreset()), creating outputDirectory if needed. Decoding, filtering
+// and encoding run as a pipeline, each stage on its own pool of workers
+// passing images on through bounded queues, so a slow stage makes the
+// others wait instead of piling up images. Prints images per second,
+// megapixels per second and how busy each stage was at the end.
+// Returns the process exit code: non-zero if any image failed.
+int RunBatch(const char *inputDirectory, char effectKey, const char *outputDirectory, const BatchStages &stages = BatchStages());
+
+// writes image (bottom row first) as a JPEG if the path ends in .jpg or
+// .jpeg and as a PNG otherwise, with alpha only if some pixel is not opaque;
+// bytes holds the 8-bit conversion and keeps its memory for the next image.
+// Call stbi_flip_vertically_on_write(1) first.
+bool WriteImage(const MyImage &image, const std::string &path, std::vector<unsigned char> *bytes);
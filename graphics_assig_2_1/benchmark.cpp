@@ -0,0 +1,388 @@
+#include "benchmark.h"
+#include "blur.h"
+#include "filterpass.h"
+#include "filters.h"
+#include "integral.h"
+#include "offscreen.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+// average wall time of fn in milliseconds
+static double TimeMs(int runs, const function<void()> &fn)
+{
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < runs; i++) fn();
+	chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	return elapsed.count() / runs;
+}
+
+int RunFilterBenchmark(const char *filename)
+{
+	MyImage image;
+	if (!LoadImage(&image, filename)) {
+		return -1;
+	}
+
+	cout << "CPU filter benchmark: " << filename << " (" << image.width << " x " << image.height
+		 << ", " << thread::hardware_concurrency() << " threads)" << endl;
+
+	const int runs = 5;
+	for (const char *key = "ZXCVBSADLKJHG"; *key; key++) {
+		FilterParams params;
+		FilterPreset(*key, &params);
+		double mpixPerSecond = FilterThroughput(image, params, runs);
+		double msPerFrame = image.width * (double)image.height / 1e3 / mpixPerSecond;
+
+		cout << "  " << *key << "  " << left << setw(40) << FilterPresetName(*key) << right
+			 << fixed << setprecision(1) << setw(10) << mpixPerSecond << " Mpix/s"
+			 << setw(10) << setprecision(2) << msPerFrame << " ms" << endl;
+	}
+
+	// the separable Gaussian grows with the radius (3 sigma), the stacked box
+	// blur should not
+	cout << endl << "  radius    gauss ms   box blur ms" << endl;
+	for (int radius : { 5, 10, 25, 50, 100, 200 }) {
+		float sigma = radius / 3.0f;
+		MyImage blurred;
+		double gaussMs = TimeMs(2, [&]() { Gauss(image, &blurred, sigma); });
+		double boxMs = TimeMs(2, [&]() { StackedBoxBlur(image, &blurred, sigma); });
+
+		cout << "  " << setw(6) << radius << fixed << setprecision(2)
+			 << setw(12) << gaussMs << setw(14) << boxMs << endl;
+	}
+
+	// the recursive Gaussian against the exact one, in 8-bit steps
+	cout << endl << "  sigma    gauss ms   recursive ms   max error   rms error" << endl;
+	for (float sigma : { 0.8f, 1.5f, 2.5f, 5.0f, 10.3f, 25.0f, 60.0f }) {
+		MyImage exact, recursive;
+		double gaussMs = TimeMs(2, [&]() { Gauss(image, &exact, sigma); });
+		double recursiveMs = TimeMs(2, [&]() { RecursiveGauss(image, &recursive, sigma); });
+
+		double maxError = 0, sumSquares = 0;
+		for (size_t i = 0; i < exact.pixels.size(); i++) {
+			double error = fabs(exact.pixels[i] - recursive.pixels[i]) * 255;
+			maxError = max(maxError, error);
+			sumSquares += error * error;
+		}
+		double rmsError = sqrt(sumSquares / exact.pixels.size());
+
+		cout << "  " << fixed << setprecision(1) << setw(5) << sigma << setprecision(2)
+			 << setw(12) << gaussMs << setw(15) << recursiveMs
+			 << setw(12) << maxError << setw(12) << rmsError << endl;
+	}
+
+	// the CPU mipmap chain, as built for the headless path
+	vector<MyImage> levels;
+	double mipMs = TimeMs(3, [&]() { BuildMipChain(image, &levels); });
+	cout << endl << fixed << setprecision(2)
+		 << "  mipmap chain (" << levels.size() << " levels) " << mipMs << " ms" << endl;
+
+	// summed-area tables over the decoded 8-bit pixels
+	MyPixels pixels;
+	if (DecodePixels(&pixels, filename)) {
+		IntegralImage32 table32;
+		IntegralImage64 table64;
+		MyImage mean;
+		double build32 = TimeMs(3, [&]() { BuildIntegralImage(&table32, pixels); });
+		double build64 = TimeMs(3, [&]() { BuildIntegralImage(&table64, pixels); });
+		double meanMs = TimeMs(3, [&]() { IntegralBoxMean(table32, &mean, 50); });
+		DestroyPixels(&pixels);
+
+		cout << endl << fixed << setprecision(2)
+			 << "  integral image build  32-bit " << build32 << " ms, 64-bit " << build64 << " ms" << endl
+			 << "  integral box mean (radius 50) " << meanMs << " ms" << endl;
+	}
+	return 0;
+}
+
+// --------------------------------------------------------------------------
+// Effect suite
+
+EffectTiming::EffectTiming() : effect(0), width(0), height(0), medianMs(0), maxMs(0), p99Ms(0), mpixPerSecond(0)
+	{}
+
+SuiteOptions::SuiteOptions() : frames(15), warmup(5), cpu(true), gl(true), tolerance(0.1)
+	{}
+
+// fills in the median, maximum and, given enough frames, 99th percentile
+// (nearest rank) of the frame times
+static void Summarize(vector<double> *ms, EffectTiming *timing)
+{
+	sort(ms->begin(), ms->end());
+	size_t n = ms->size();
+	timing->medianMs = n % 2 ? (*ms)[n / 2] : ((*ms)[n / 2 - 1] + (*ms)[n / 2]) / 2;
+	timing->maxMs = ms->back();
+	timing->p99Ms = n >= (size_t)MIN_P99_FRAMES ? (*ms)[(size_t)ceil(0.99 * n) - 1] : 0;
+	timing->mpixPerSecond = timing->width * (double)timing->height / 1e3 / max(timing->medianMs, 1e-9);
+}
+
+// times frames runs of render after warmup untimed ones
+static void TimeEffect(int warmup, int frames, const function<void()> &render, EffectTiming *timing)
+{
+	for (int i = 0; i < warmup; i++) render();
+	vector<double> ms;
+	for (int i = 0; i < frames; i++) ms.push_back(TimeMs(1, render));
+	Summarize(&ms, timing);
+}
+
+static void PrintTiming(const EffectTiming &timing)
+{
+	cout << "  " << left << setw(4) << timing.engine << setw(28) << timing.image << timing.effect << "  "
+		 << setw(40) << FilterPresetName(timing.effect) << right << fixed << setprecision(2)
+		 << "median " << setw(9) << timing.medianMs << " ms  " << (timing.p99Ms > 0 ? "p99 " : "max ") << setw(9)
+		 << (timing.p99Ms > 0 ? timing.p99Ms : timing.maxMs) << " ms"
+		 << setprecision(1) << setw(10) << timing.mpixPerSecond << " Mpix/s" << endl;
+}
+
+bool TimeCpuEffects(const string &filename, int warmup, int frames, vector<EffectTiming> *timings)
+{
+	MyImage image;
+	if (!LoadImage(&image, filename.c_str())) return false;
+
+	for (const char *key = SUITE_EFFECTS; *key; key++) {
+		FilterParams params;
+		FilterPreset(*key, &params);
+		MyImage filtered;
+		FilterScratch scratch;
+
+		EffectTiming timing;
+		timing.engine = "cpu";
+		timing.image = filename;
+		timing.effect = *key;
+		timing.width = image.width;
+		timing.height = image.height;
+		TimeEffect(warmup, frames, [&]() { ApplyFilter(image, &filtered, params, &scratch); }, &timing);
+		PrintTiming(timing);
+		timings->push_back(timing);
+	}
+	return true;
+}
+
+bool TimeGlEffects(const string &filename, int warmup, int frames, vector<EffectTiming> *timings)
+{
+	MyTexture source;
+	FilterPass filterPass;
+	BlurPass blurPass;
+	if (!InitializeTexture(&source, filename.c_str()) || !InitializeFilterPass(&filterPass) ||
+		!InitializeBlurPass(&blurPass)) {
+		DestroyTexture(&source);
+		DestroyFilterPass(&filterPass);
+		DestroyBlurPass(&blurPass);
+		return false;
+	}
+
+	bool succeeded = true;
+	for (const char *key = SUITE_EFFECTS; *key; key++) {
+		FilterParams params;
+		FilterPreset(*key, &params);
+		UpdateFilterUniforms(&filterPass, params, source.width, source.height);
+
+		// the passes the viewer runs when the effect is selected; glFinish()
+		// so the time is the GPU's and not just the time to queue the work.
+		// A pass that renders nothing, e.g. into an incomplete target, fails
+		// the effect rather than timing a no-op.
+		bool rendered = true;
+		auto render = [&]() {
+			const MyTexture *result;
+			if (SelectEffect(params) == EFFECT_GAUSS) {
+				result = RenderGaussianBlur(&blurPass, source, GaussSigma(params));
+			} else {
+				result = RenderFilter(&filterPass, source, params);
+			}
+			if (!result) rendered = false;
+			glFinish();
+		};
+
+		EffectTiming timing;
+		timing.engine = "gl";
+		timing.image = filename;
+		timing.effect = *key;
+		timing.width = source.width;
+		timing.height = source.height;
+		TimeEffect(warmup, frames, render, &timing);
+		if (!rendered) {
+			cout << "  gl  " << filename << " " << *key << "  " << FilterPresetName(*key) << " rendered nothing" << endl;
+			succeeded = false;
+			continue;
+		}
+		PrintTiming(timing);
+		timings->push_back(timing);
+	}
+
+	DestroyBlurPass(&blurPass);
+	DestroyFilterPass(&filterPass);
+	DestroyTexture(&source);
+	return !CheckGLErrors("Effect suite: ") && succeeded;
+}
+
+static string JsonEscape(const string &text)
+{
+	string escaped;
+	for (char c : text) {
+		if (c == '"' || c == '\\') escaped += '\\';
+		escaped += c;
+	}
+	return escaped;
+}
+
+bool WriteTimingsJson(const vector<EffectTiming> &timings, int warmup, int frames, const char *path)
+{
+	ofstream file(path);
+	file << "{" << endl << "  \"warmup\": " << warmup << "," << endl << "  \"frames\": " << frames << "," << endl
+		 << "  \"results\": [" << endl;
+	for (size_t i = 0; i < timings.size(); i++) {
+		const EffectTiming &timing = timings[i];
+		file << "    { \"engine\": \"" << timing.engine << "\", \"image\": \"" << JsonEscape(timing.image)
+			 << "\", \"effect\": \"" << timing.effect << "\", \"name\": \"" << FilterPresetName(timing.effect)
+			 << "\", \"width\": " << timing.width << ", \"height\": " << timing.height << fixed << setprecision(4)
+			 << ", \"median_ms\": " << timing.medianMs << ", \"max_ms\": " << timing.maxMs;
+		if (timing.p99Ms > 0) file << ", \"p99_ms\": " << timing.p99Ms;
+		file << ", \"mpix_per_s\": " << setprecision(2) << timing.mpixPerSecond << " }"
+			 << (i + 1 < timings.size() ? "," : "") << endl;
+	}
+	file << "  ]" << endl << "}" << endl;
+
+	if (!file) {
+		cout << "Could not write " << path << endl;
+		return false;
+	}
+	cout << "Wrote " << timings.size() << " results to " << path << endl;
+	return true;
+}
+
+// the string value of "key": "..." in a line WriteTimingsJson() wrote
+static bool JsonString(const string &line, const char *key, string *value)
+{
+	size_t start = line.find("\"" + string(key) + "\": \"");
+	if (start == string::npos) return false;
+	value->clear();
+	for (size_t i = start + strlen(key) + 5; i < line.size(); i++) {
+		if (line[i] == '"') return true;
+		if (line[i] == '\\' && i + 1 < line.size()) i++;
+		*value += line[i];
+	}
+	return false;
+}
+
+// the number value of "key": ... in such a line
+static bool JsonNumber(const string &line, const char *key, double *value)
+{
+	size_t start = line.find("\"" + string(key) + "\": ");
+	if (start == string::npos) return false;
+	const char *number = line.c_str() + start + strlen(key) + 4;
+	char *end = nullptr;
+	*value = strtod(number, &end);
+	return end != number;
+}
+
+bool ReadTimingsJson(const char *path, vector<EffectTiming> *timings)
+{
+	ifstream file(path);
+	if (!file) {
+		cout << "Could not read " << path << endl;
+		return false;
+	}
+
+	string line;
+	while (getline(file, line)) {
+		if (line.find("\"engine\"") == string::npos) continue;
+
+		EffectTiming timing;
+		string effect;
+		double width = 0, height = 0;
+		if (!JsonString(line, "engine", &timing.engine) || !JsonString(line, "image", &timing.image) ||
+			!JsonString(line, "effect", &effect) || effect.size() != 1 || !JsonNumber(line, "width", &width) ||
+			!JsonNumber(line, "height", &height) || !JsonNumber(line, "median_ms", &timing.medianMs) ||
+			!JsonNumber(line, "mpix_per_s", &timing.mpixPerSecond)) {
+			cout << path << " has a result this program cannot read: " << line << endl;
+			return false;
+		}
+		// both are missing from older files or too short runs
+		JsonNumber(line, "max_ms", &timing.maxMs);
+		JsonNumber(line, "p99_ms", &timing.p99Ms);
+		timing.effect = effect[0];
+		timing.width = (int)width;
+		timing.height = (int)height;
+		timings->push_back(timing);
+	}
+	return true;
+}
+
+bool CompareTimings(const vector<EffectTiming> &timings, const vector<EffectTiming> &baseline, double tolerance)
+{
+	cout << endl << "Against the baseline (median ms, regressions above " << fixed << setprecision(0)
+		 << tolerance * 100 << "%):" << endl;
+
+	unsigned regressions = 0;
+	for (const EffectTiming &timing : timings) {
+		auto match = find_if(baseline.begin(), baseline.end(), [&](const EffectTiming &old) {
+			return old.engine == timing.engine && old.image == timing.image && old.effect == timing.effect;
+		});
+		cout << "  " << left << setw(4) << timing.engine << setw(28) << timing.image << timing.effect << right;
+		if (match == baseline.end()) {
+			cout << "  not in the baseline" << endl;
+			continue;
+		}
+
+		double change = timing.medianMs / max(match->medianMs, 1e-9) - 1;
+		bool regressed = change > tolerance;
+		if (regressed) regressions++;
+		cout << fixed << setprecision(2) << setw(10) << match->medianMs << " -> " << setw(9) << timing.medianMs
+			 << showpos << setprecision(1) << setw(9) << change * 100 << "%" << noshowpos
+			 << (regressed ? "  REGRESSION" : "") << endl;
+	}
+
+	if (regressions > 0) cout << regressions << " results are slower than the baseline" << endl;
+	return regressions == 0;
+}
+
+int RunEffectSuite(const SuiteOptions &options)
+{
+	int frames = max(options.frames, 1);
+	int warmup = max(options.warmup, 0);
+	cout << "Effect suite: " << options.images.size() << " images, " << frames << " frames per effect after "
+		 << warmup << " untimed, "
+		 << thread::hardware_concurrency() << " threads" << endl;
+
+	vector<EffectTiming> timings;
+	bool succeeded = true;
+	if (options.cpu) {
+		for (const string &image : options.images) {
+			if (!TimeCpuEffects(image, warmup, frames, &timings)) succeeded = false;
+		}
+	}
+	if (options.gl) {
+		OffscreenContext offscreen;
+		if (InitializeOffscreenContext(&offscreen)) {
+			cout << "OpenGL " << glGetString(GL_VERSION) << ", " << glGetString(GL_RENDERER) << endl;
+			for (const string &image : options.images) {
+				if (!TimeGlEffects(image, warmup, frames, &timings)) succeeded = false;
+			}
+			DestroyOffscreenContext(&offscreen);
+		} else {
+			cout << "Could not create an OpenGL 4.1 context, skipping the GL results" << endl;
+			succeeded = false;
+		}
+	}
+
+	if (!options.jsonPath.empty() && !WriteTimingsJson(timings, warmup, frames, options.jsonPath.c_str())) succeeded = false;
+	if (!options.baselinePath.empty()) {
+		vector<EffectTiming> baseline;
+		if (!ReadTimingsJson(options.baselinePath.c_str(), &baseline) ||
+			!CompareTimings(timings, baseline, options.tolerance)) {
+			succeeded = false;
+		}
+	}
+	return succeeded ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------------------------
+// Headless benchmark of the CPU filter engine (no window or GPU required)
+
+// runs every effect preset over the image and prints megapixels per second,
+// returning the process exit code
+int RunFilterBenchmark(const char *filename);
+
+// --------------------------------------------------------------------------
+// Effect suite: every effect of fragment.glsl on a set of images, through
+// the CPU engine and through OpenGL in an offscreen context, with the
+// results written as JSON and compared with an earlier run
+
+// the effect keys the suite times: the luminance presets, brightness, both
+// Sobels, the unsharp mask and the 3, 5 and 7 texel Gaussians
+const char *const SUITE_EFFECTS = "ZXCVSADLKJ";
+
+// the fewest frames a 99th percentile is reported for; with fewer it would
+// only be the slowest frame under another name
+const int MIN_P99_FRAMES = 100;
+
+// time per frame of one effect on one image through one engine
+struct EffectTiming
+{
+	std::string engine;		// "cpu" or "gl"
+	std::string image;
+	char effect;			// the effect key
+	int width;
+	int height;
+	double medianMs;
+	double maxMs;
+	double p99Ms;			// 0 when fewer than MIN_P99_FRAMES were timed
+	double mpixPerSecond;	// at the median time
+
+	// initialize to an untimed effect
+	EffectTiming();
+};
+
+struct SuiteOptions
+{
+	std::vector<std::string> images;
+	int frames;				// timed runs of each effect
+	int warmup;				// untimed runs before them
+	bool cpu;
+	bool gl;
+	std::string jsonPath;		// written when not empty
+	std::string baselinePath;	// compared with when not empty
+	double tolerance;		// slowdown of the median allowed, as a fraction
+
+	// initialize to 15 frames after 5 warm-up runs through both engines,
+	// 10% tolerance
+	SuiteOptions();
+};
+
+// times each suite effect on an image through the CPU engine, discarding the
+// first warmup runs (first-touch page faults, caches, clock ramp-up)
+bool TimeCpuEffects(const std::string &filename, int warmup, int frames, std::vector<EffectTiming> *timings);
+
+// the same through OpenGL; needs a current context with glad loaded, and
+// waits for each frame to finish so the time covers the GPU's work. The
+// warm-up runs also take shader compilation out of the timing.
+bool TimeGlEffects(const std::string &filename, int warmup, int frames, std::vector<EffectTiming> *timings);
+
+// writes the timings as a JSON document, one result per line; p99_ms is
+// left out of results with too few frames for it
+bool WriteTimingsJson(const std::vector<EffectTiming> &timings, int warmup, int frames, const char *path);
+
+// reads the results of a file WriteTimingsJson() wrote
+bool ReadTimingsJson(const char *path, std::vector<EffectTiming> *timings);
+
+// prints each result's median against the baseline's, returning false if
+// any is slower by more than the tolerance
+bool CompareTimings(const std::vector<EffectTiming> &timings, const std::vector<EffectTiming> &baseline, double tolerance);
+
+// runs the suite, creating an offscreen context (offscreen.h) for OpenGL, and
+// returns the process exit code: non-zero if anything failed or regressed
+int RunEffectSuite(const SuiteOptions &options);
@@ -0,0 +1,132 @@
+#include "blur.h"
+#include "filters.h"
+#include "shader.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// must match MAX_TAPS in shaders/blur.glsl
+static const int MAX_TAPS = 64;
+
+BlurPass::BlurPass() : program(0), vertexArray(0), stepLocation(-1), tapCountLocation(-1),
+	tapOffsetsLocation(-1), tapWeightsLocation(-1), opaqueLocation(-1), sourceLodLocation(-1)
+	{}
+
+bool InitializeBlurPass(BlurPass *pass)
+{
+	string vertexSource = LoadSource("shaders/fullscreen.glsl");
+	string fragmentSource = LoadSource("shaders/blur.glsl");
+	if (vertexSource.empty() || fragmentSource.empty()) return false;
+
+	GLuint vertex = CompileShader(GL_VERTEX_SHADER, vertexSource);
+	GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+	pass->program = LinkProgram(vertex, fragment);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+
+	pass->stepLocation = glGetUniformLocation(pass->program, "blurStep");
+	pass->tapCountLocation = glGetUniformLocation(pass->program, "tapCount");
+	pass->tapOffsetsLocation = glGetUniformLocation(pass->program, "tapOffsets");
+	pass->tapWeightsLocation = glGetUniformLocation(pass->program, "tapWeights");
+	pass->opaqueLocation = glGetUniformLocation(pass->program, "opaque");
+	pass->sourceLodLocation = glGetUniformLocation(pass->program, "sourceLod");
+
+	glGenVertexArrays(1, &pass->vertexArray);
+	return !CheckGLErrors("Initializing blur pass: ");
+}
+
+// folds each pair of neighbouring taps into one fetch between them, which
+// linear filtering turns back into their weighted sum
+static void LinearTaps(const vector<float> &weights, vector<float> *offsets, vector<float> *pairWeights)
+{
+	offsets->assign(1, 0.0f);
+	pairWeights->assign(1, weights[0]);
+	for (size_t i = 1; i < weights.size(); i += 2) {
+		float w1 = weights[i];
+		float w2 = i + 1 < weights.size() ? weights[i + 1] : 0.0f;
+		offsets->push_back((i * w1 + (i + 1) * w2) / (w1 + w2));
+		pairWeights->push_back(w1 + w2);
+	}
+}
+
+// sigma a blur on the given mipmap level needs, in texels of that level, to
+// match sigma on the base level: each halving is taken as a 2 x 2 box, which
+// has already spread the image by a variance of 1/4 of a texel of the level
+// above it
+static float LevelSigma(float sigma, int level)
+{
+	float boxVariance = ((float)(1 << (2 * level)) - 1.0f) / 12.0f;
+	return sqrt(max(sigma * sigma - boxVariance, 0.0f)) / (float)(1 << level);
+}
+
+static void RunBlurPass(BlurPass *pass, const MyTexture &source, int level, MyRenderTarget *target,
+						float stepX, float stepY, bool opaque)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+	glViewport(0, 0, target->texture.width, target->texture.height);
+	glUniform2f(pass->stepLocation, stepX, stepY);
+	glUniform1f(pass->opaqueLocation, opaque ? 1.0f : 0.0f);
+	glUniform1f(pass->sourceLodLocation, (float)level);
+	glBindTexture(source.target, source.textureID);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+MyTexture *RenderGaussianBlur(BlurPass *pass, const MyTexture &source, float sigma)
+{
+	TraceSpan span("RenderGaussianBlur");
+	sigma = min(max(sigma, 0.1f), MAX_BLUR_SIGMA);
+
+	// the smallest level that still leaves MIN_LEVEL_SIGMA texels to blur
+	// gives the same image for a fraction of the fetches and bandwidth
+	int level = 0;
+	while (level + 1 < source.levels && LevelSigma(sigma, level + 1) >= MIN_LEVEL_SIGMA) level++;
+	int width = max(source.width >> level, 1);
+	int height = max(source.height >> level, 1);
+
+	for (MyRenderTarget &target : pass->targets) {
+		if (!InitializeRenderTarget(&target, width, height)) return nullptr;
+	}
+
+	vector<float> weights, offsets, pairWeights;
+	GaussianKernel(LevelSigma(sigma, level), &weights);
+	LinearTaps(weights, &offsets, &pairWeights);
+	int tapCount = min((int)offsets.size(), MAX_TAPS);
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glUseProgram(pass->program);
+	glBindVertexArray(pass->vertexArray);
+	glUniform1i(pass->tapCountLocation, tapCount);
+	glUniform1fv(pass->tapOffsetsLocation, tapCount, &offsets[0]);
+	glUniform1fv(pass->tapWeightsLocation, tapCount, &pairWeights[0]);
+
+	RunBlurPass(pass, source, level, &pass->targets[0], 1.0f / width, 0.0f, false);
+	RunBlurPass(pass, pass->targets[0].texture, 0, &pass->targets[1], 0.0f, 1.0f / height, true);
+
+	// reset state to default (window framebuffer, no shader or geometry bound)
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	// for drawing the result zoomed out
+	GenerateMipmaps(&pass->targets[1].texture);
+
+	CheckGLErrors("Gaussian blur: ");
+	return &pass->targets[1].texture;
+}
+
+// deallocate blur-related objects
+void DestroyBlurPass(BlurPass *pass)
+{
+	for (MyRenderTarget &target : pass->targets) DestroyRenderTarget(&target);
+	glDeleteVertexArrays(1, &pass->vertexArray);
+	glDeleteProgram(pass->program);
+	*pass = BlurPass();
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// Separable Gaussian blur on the GPU: a horizontal and a vertical pass of
+// shaders/blur.glsl, ping-ponging between two framebuffers at image size
+
+// largest sigma the tap arrays in blur.glsl can hold
+const float MAX_BLUR_SIGMA = 42.0f;
+
+// blurs run on a smaller mipmap level as long as sigma stays this wide
+// there, which keeps them within two 8-bit steps of the full-size blur
+// (more within a few sigma of the borders, which clamp to a coarser edge)
+const float MIN_LEVEL_SIGMA = 3.0f;
+
+struct BlurPass
+{
+	GLuint program;
+	GLuint vertexArray;		// empty, fullscreen.glsl makes its own triangle
+	GLint stepLocation;
+	GLint tapCountLocation;
+	GLint tapOffsetsLocation;
+	GLint tapWeightsLocation;
+	GLint opaqueLocation;
+	GLint sourceLodLocation;
+	MyRenderTarget targets[2];
+
+	// initialize object names to zero (OpenGL reserved value)
+	BlurPass();
+};
+
+bool InitializeBlurPass(BlurPass *pass);
+
+// blurs source with the given standard deviation in texels, returning the
+// texture that holds the result until the next call. When source has
+// mipmaps a wide blur runs on a smaller level, so the result may be smaller
+// than source (it covers the same image).
+MyTexture *RenderGaussianBlur(BlurPass *pass, const MyTexture &source, float sigma);
+
+// deallocate blur-related objects
+void DestroyBlurPass(BlurPass *pass);
@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// --------------------------------------------------------------------------
+// Fixed-capacity lock-free queue for any number of producer and consumer
+// threads (Dmitry Vyukov's bounded MPMC queue)
+//
+// Each cell carries a sequence number saying whose turn it is: a producer
+// may fill cell i when its sequence equals the position it claimed, and a
+// consumer may empty it once the sequence is one past that. Positions are
+// claimed with a compare-and-swap, so threads never wait on each other
+// except when the queue is full or empty, which TryPush() and TryPop()
+// report instead of blocking.
+
+template <typename T>
+struct BoundedQueueCell
+{
+	std::atomic<size_t> sequence;
+	T value;
+};
+
+template <typename T>
+struct BoundedQueue
+{
+	size_t mask;		// capacity - 1, the capacity being a power of two
+	std::unique_ptr<BoundedQueueCell<T>[]> cells;
+
+	// producers and consumers on their own cache lines
+	alignas(64) std::atomic<size_t> enqueuePosition;
+	alignas(64) std::atomic<size_t> dequeuePosition;
+
+	// initialize to an empty queue holding at least capacity values
+	explicit BoundedQueue(size_t capacity) : mask(0), enqueuePosition(0), dequeuePosition(0)
+	{
+		size_t size = 2;
+		while (size < capacity) size *= 2;
+		mask = size - 1;
+		cells.reset(new BoundedQueueCell<T>[size]);
+		for (size_t i = 0; i < size; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+};
+
+// appends value, returning false if the queue is full
+template <typename T>
+inline bool TryPush(BoundedQueue<T> *queue, const T &value)
+{
+	size_t position = queue->enqueuePosition.load(std::memory_order_relaxed);
+	for (;;) {
+		BoundedQueueCell<T> &cell = queue->cells[position & queue->mask];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		ptrdiff_t turn = (ptrdiff_t)sequence - (ptrdiff_t)position;
+		if (turn == 0) {
+			if (queue->enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				cell.value = value;
+				cell.sequence.store(position + 1, std::memory_order_release);
+				return true;
+			}
+		} else if (turn < 0) {
+			return false;
+		} else {
+			position = queue->enqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+// removes the oldest value into *value, returning false if the queue is empty
+template <typename T>
+inline bool TryPop(BoundedQueue<T> *queue, T *value)
+{
+	size_t position = queue->dequeuePosition.load(std::memory_order_relaxed);
+	for (;;) {
+		BoundedQueueCell<T> &cell = queue->cells[position & queue->mask];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		ptrdiff_t turn = (ptrdiff_t)sequence - (ptrdiff_t)(position + 1);
+		if (turn == 0) {
+			if (queue->dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				*value = cell.value;
+				cell.sequence.store(position + queue->mask + 1, std::memory_order_release);
+				return true;
+			}
+		} else if (turn < 0) {
+			return false;
+		} else {
+			position = queue->dequeuePosition.load(std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,116 @@
+#include "cpublur.h"
+#include "filters.h"
+#include "trace.h"
+#include <chrono>
+#include <sstream>
+
+using namespace std;
+
+CpuBlurResult::CpuBlurResult() : width(0), height(0), blurMs(0)
+	{}
+
+CpuBlurWorker::CpuBlurWorker() : requested(false), finished(false), generation(0), stopping(false),
+	pixelCache(nullptr)
+	{}
+
+string CpuBlurKey(const CpuBlurRequest &request)
+{
+	ostringstream key;
+	key << request.path << '\n' << (request.recursive ? "recursive gauss " : "box blur ") << request.sigma;
+	return key.str();
+}
+
+// the blur at the image's full size as 8-bit RGBA; false if it cannot be loaded
+static bool BlurImage(PixelCache *pixelCache, const CpuBlurRequest &request, CpuBlurResult *result)
+{
+	TraceSpan span("cpu blur");
+	MyPixels pixels;
+	MyImage source;
+	if (!LoadPixels(pixelCache, &pixels, request.path.c_str())) return false;
+	bool converted = InitializeImage(&source, pixels);
+	DestroyPixels(&pixels);
+	if (!converted) return false;
+
+	MyImage blurred;
+	FilterScratch scratch;
+	if (request.recursive) {
+		RecursiveGauss(source, &blurred, request.sigma, &scratch);
+	} else {
+		StackedBoxBlur(source, &blurred, request.sigma, &scratch);
+	}
+	StoreImage(blurred, &result->bytes, 4);
+	result->width = blurred.width;
+	result->height = blurred.height;
+	return true;
+}
+
+static void BlurThread(CpuBlurWorker *worker)
+{
+	SetTraceThreadName("cpu blur");
+	unique_lock<mutex> lock(worker->mutex);
+	for (;;) {
+		worker->wake.wait(lock, [&]() { return worker->stopping || worker->requested; });
+		if (worker->stopping) return;
+
+		CpuBlurResult result;
+		result.request = worker->request;
+		worker->requested = false;
+		unsigned generation = worker->generation;
+
+		lock.unlock();
+		auto start = chrono::steady_clock::now();
+		bool blurred = BlurImage(worker->pixelCache, result.request, &result);
+		result.blurMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		lock.lock();
+
+		// another blur was asked for while this one ran
+		if (!blurred || generation != worker->generation) continue;
+		worker->result = move(result);
+		worker->finished = true;
+		if (worker->notify) worker->notify();
+	}
+}
+
+bool InitializeCpuBlurWorker(CpuBlurWorker *worker, PixelCache *pixelCache, const function<void()> &notify)
+{
+	worker->pixelCache = pixelCache;
+	worker->notify = notify;
+	worker->stopping = false;
+	worker->thread = thread(BlurThread, worker);
+	return true;
+}
+
+void RequestCpuBlur(CpuBlurWorker *worker, const CpuBlurRequest &request)
+{
+	lock_guard<mutex> lock(worker->mutex);
+	worker->generation++;
+	worker->request = request;
+	worker->requested = true;
+	worker->finished = false;
+	worker->result = CpuBlurResult();
+	worker->wake.notify_one();
+}
+
+bool TakeCpuBlur(CpuBlurWorker *worker, CpuBlurResult *result)
+{
+	lock_guard<mutex> lock(worker->mutex);
+	if (!worker->finished) return false;
+
+	*result = move(worker->result);
+	worker->result = CpuBlurResult();
+	worker->finished = false;
+	return true;
+}
+
+void DestroyCpuBlurWorker(CpuBlurWorker *worker)
+{
+	{
+		lock_guard<mutex> lock(worker->mutex);
+		worker->stopping = true;
+		worker->requested = false;
+	}
+	worker->wake.notify_all();
+	if (worker->thread.joinable()) worker->thread.join();
+	worker->result = CpuBlurResult();
+	worker->finished = false;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pixelcache.h"
+
+// --------------------------------------------------------------------------
+// The stacked box and recursive Gaussian blurs of the viewer, run by the CPU
+// filter engine on a thread of their own, so the window keeps drawing the
+// unblurred image while a wide sigma is worked out. Like the image loader
+// only the newest request matters. The pixels come from the pixel cache
+// when the image has an entry, and the float copies of the image exist only
+// while a blur runs.
+
+struct CpuBlurRequest
+{
+	std::string path;
+	float sigma;
+	bool recursive;		// RecursiveGauss(), otherwise StackedBoxBlur()
+};
+
+struct CpuBlurResult
+{
+	CpuBlurRequest request;
+	std::vector<unsigned char> bytes;	// RGBA, bottom row first
+	int width;
+	int height;
+	double blurMs;		// loading, blurring and converting to bytes
+
+	// initialize to no pixels
+	CpuBlurResult();
+};
+
+struct CpuBlurWorker
+{
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+
+	// guarded by mutex
+	bool requested;			// request is waiting for the thread
+	CpuBlurRequest request;
+	bool finished;			// result is waiting for TakeCpuBlur()
+	CpuBlurResult result;
+	unsigned generation;	// of the newest request, older ones are stale
+	bool stopping;
+
+	// called on the blur thread when a result is ready, to wake the GL
+	// thread (e.g. glfwPostEmptyEvent)
+	std::function<void()> notify;
+
+	// when set, images are looked up in the pixel cache before decoding
+	PixelCache *pixelCache;
+
+	// initialize to a worker with no thread
+	CpuBlurWorker();
+};
+
+// the texture cache key of the blurred image, distinct from the image's own
+std::string CpuBlurKey(const CpuBlurRequest &request);
+
+bool InitializeCpuBlurWorker(CpuBlurWorker *worker, PixelCache *pixelCache, const std::function<void()> &notify);
+
+// queues the blur, making any earlier request or untaken result stale
+void RequestCpuBlur(CpuBlurWorker *worker, const CpuBlurRequest &request);
+
+// hands over the newest request's result once it is ready, returning false
+// if it is not (or the image could not be loaded)
+bool TakeCpuBlur(CpuBlurWorker *worker, CpuBlurResult *result);
+
+// stops the thread, waiting for any blur in progress
+void DestroyCpuBlurWorker(CpuBlurWorker *worker);
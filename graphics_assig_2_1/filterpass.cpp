@@ -0,0 +1,149 @@
+#include "filterpass.h"
+#include "shader.h"
+#include "trace.h"
+#include <string>
+
+using namespace std;
+
+static const char *variantDefines[VARIANT_COUNT] = {
+	"",
+	"#define EFFECT_LUMINANCE\n",
+	"#define EFFECT_BRIGHTNESS\n",
+	"#define EFFECT_SOBEL\n#define SOBEL_HORIZONTAL\n",
+	"#define EFFECT_SOBEL\n",
+	"#define EFFECT_UNSHARP\n"
+};
+
+// the FilterUniforms block of fragment.glsl in std140 layout
+struct FilterUniforms
+{
+	float luminanceValues[3];	// a vec3, padded out by the next float
+	float adjustBrightness;
+	float doSobel;
+	float horSobel;
+	float doUnSharp;
+	float doGauss;
+	float gaussVal;
+	float imageWidth;
+	float imageHeight;
+	float padding;
+};
+
+ShaderVariant SelectVariant(const FilterParams &params)
+{
+	switch (SelectEffect(params)) {
+		case EFFECT_LUMINANCE:
+			return VARIANT_LUMINANCE;
+		case EFFECT_BRIGHTNESS:
+			return VARIANT_BRIGHTNESS;
+		case EFFECT_SOBEL:
+			return params.horSobel > 0 ? VARIANT_SOBEL_HORIZONTAL : VARIANT_SOBEL_VERTICAL;
+		case EFFECT_UNSHARP:
+			return VARIANT_UNSHARP;
+		default:
+			return VARIANT_ORIGINAL;
+	}
+}
+
+const char *VariantDefines(ShaderVariant variant)
+{
+	return variantDefines[variant];
+}
+
+FilterPass::FilterPass() : vertexArray(0), uniformBuffer(0)
+{
+	for (GLuint &program : programs) program = 0;
+}
+
+bool InitializeFilterPass(FilterPass *pass)
+{
+	string vertexSource = LoadSource("shaders/fullscreen.glsl");
+	string fragmentSource = LoadSource("shaders/fragment.glsl");
+	if (vertexSource.empty() || fragmentSource.empty()) return false;
+
+	GLuint vertex = CompileShader(GL_VERTEX_SHADER, vertexSource);
+	for (int i = 0; i < VARIANT_COUNT; i++) {
+		GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, DefineSource(fragmentSource, variantDefines[i]));
+		pass->programs[i] = LinkProgram(vertex, fragment);
+		glDeleteShader(fragment);
+
+		// a variant that reads no settings may have had the block removed
+		GLuint block = glGetUniformBlockIndex(pass->programs[i], "FilterUniforms");
+		if (block != GL_INVALID_INDEX) {
+			glUniformBlockBinding(pass->programs[i], block, FILTER_UNIFORMS_BINDING);
+		}
+	}
+	glDeleteShader(vertex);
+
+	glGenBuffers(1, &pass->uniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, pass->uniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FilterUniforms), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FILTER_UNIFORMS_BINDING, pass->uniformBuffer);
+
+	glGenVertexArrays(1, &pass->vertexArray);
+	return !CheckGLErrors("Initializing filter pass: ");
+}
+
+void UpdateFilterUniforms(FilterPass *pass, const FilterParams &params, int width, int height)
+{
+	FilterUniforms uniforms = {};
+	uniforms.luminanceValues[0] = params.luminanceValues.r;
+	uniforms.luminanceValues[1] = params.luminanceValues.g;
+	uniforms.luminanceValues[2] = params.luminanceValues.b;
+	uniforms.adjustBrightness = params.adjustBrightness;
+	uniforms.doSobel = params.doSobel;
+	uniforms.horSobel = params.horSobel;
+	uniforms.doUnSharp = params.doUnSharp;
+	uniforms.doGauss = params.doGauss;
+	uniforms.gaussVal = params.gaussVal;
+	uniforms.imageWidth = width;
+	uniforms.imageHeight = height;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, pass->uniformBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(uniforms), &uniforms);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+const MyTexture *RenderFilter(FilterPass *pass, const MyTexture &source, const FilterParams &params)
+{
+	TraceSpan span("RenderFilter");
+	ShaderVariant variant = SelectVariant(params);
+	if (variant == VARIANT_ORIGINAL) return &source;
+
+	// 8 bits per channel, so results are clamped like the window's framebuffer
+	if (!InitializeRenderTarget(&pass->target, source.width, source.height, GL_RGBA8)) return nullptr;
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, pass->target.framebuffer);
+	glViewport(0, 0, source.width, source.height);
+	glUseProgram(pass->programs[variant]);
+	glBindVertexArray(pass->vertexArray);
+	glBindTexture(source.target, source.textureID);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	// reset state to default (window framebuffer, no shader or geometry bound)
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glBindTexture(source.target, 0);
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	// for drawing the result zoomed out
+	GenerateMipmaps(&pass->target.texture);
+
+	CheckGLErrors("Filter pass: ");
+	return &pass->target.texture;
+}
+
+// deallocate filter-related objects
+void DestroyFilterPass(FilterPass *pass)
+{
+	DestroyRenderTarget(&pass->target);
+	glDeleteBuffers(1, &pass->uniformBuffer);
+	glDeleteVertexArrays(1, &pass->vertexArray);
+	for (GLuint program : pass->programs) glDeleteProgram(program);
+	*pass = FilterPass();
+}
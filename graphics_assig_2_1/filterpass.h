@@ -0,0 +1,54 @@
+#pragma once
+#include "filters.h"
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// The effects of shaders/fragment.glsl run once at image resolution into a
+// framebuffer texture, which is then drawn (panned, zoomed and rotated)
+// until the image or the effect changes
+
+// the specialized programs compiled from fragment.glsl, one per effect the
+// shader can apply
+enum ShaderVariant
+{
+	VARIANT_ORIGINAL,
+	VARIANT_LUMINANCE,
+	VARIANT_BRIGHTNESS,
+	VARIANT_SOBEL_HORIZONTAL,
+	VARIANT_SOBEL_VERTICAL,
+	VARIANT_UNSHARP,
+	VARIANT_COUNT
+};
+
+// the variant that applies the selected effect (VARIANT_ORIGINAL for the
+// blurs, which are done by their own passes)
+ShaderVariant SelectVariant(const FilterParams &params);
+
+// the #defines that make fragment.glsl the given variant
+const char *VariantDefines(ShaderVariant variant);
+
+// binding point of the FilterUniforms block in fragment.glsl
+const GLuint FILTER_UNIFORMS_BINDING = 0;
+
+struct FilterPass
+{
+	GLuint programs[VARIANT_COUNT];
+	GLuint vertexArray;		// empty, fullscreen.glsl makes its own triangle
+	GLuint uniformBuffer;	// the FilterUniforms block
+	MyRenderTarget target;
+
+	// initialize object names to zero (OpenGL reserved value)
+	FilterPass();
+};
+
+bool InitializeFilterPass(FilterPass *pass);
+
+// uploads the effect settings for an image of the given size
+void UpdateFilterUniforms(FilterPass *pass, const FilterParams &params, int width, int height);
+
+// applies the selected effect to source, returning the texture that holds
+// the result until the next call (source itself when there is no effect)
+const MyTexture *RenderFilter(FilterPass *pass, const MyTexture &source, const FilterParams &params);
+
+// deallocate filter-related objects
+void DestroyFilterPass(FilterPass *pass);
@@ -0,0 +1,834 @@
+#include "filters.h"
+#include "pngstream.h"
+#include "simd.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+FilterParams::FilterParams() : adjustBrightness(0), doSobel(0), horSobel(0), doUnSharp(0), doGauss(0), gaussVal(0), gaussSigma(0), doBoxBlur(0), doRecursiveGauss(0)
+{
+	luminanceValues.r = 1.0f;
+	luminanceValues.g = 1.0f;
+	luminanceValues.b = 1.0f;
+}
+
+FilterEffect SelectEffect(const FilterParams &params)
+{
+	if (params.luminanceValues.r != 1) {
+		return EFFECT_LUMINANCE;
+	} else if (params.adjustBrightness > 0) {
+		return EFFECT_BRIGHTNESS;
+	} else if (params.doSobel > 0) {
+		return EFFECT_SOBEL;
+	} else if (params.doUnSharp > 0) {
+		return EFFECT_UNSHARP;
+	} else if (params.doGauss > 0) {
+		return EFFECT_GAUSS;
+	} else if (params.doBoxBlur > 0) {
+		return EFFECT_BOXBLUR;
+	} else if (params.doRecursiveGauss > 0) {
+		return EFFECT_RECURSIVE_GAUSS;
+	}
+	return EFFECT_ORIGINAL;
+}
+
+float GaussSigma(const FilterParams &params)
+{
+	if (params.gaussSigma > 0) return params.gaussSigma;
+
+	// per-axis standard deviation of the old (cos(pi * d / r) + 1) / 2 disc
+	int r = (int)ceil(params.gaussVal - 0.5f);
+	return 0.3412f * max(r, 1);
+}
+
+// --------------------------------------------------------------------------
+// Effect presets, one per key handled in KeyCallback
+
+struct FilterPresetEntry
+{
+	char key;
+	const char *name;
+	float r, g, b;
+	float adjustBrightness;
+	float doSobel;
+	float horSobel;
+	float doUnSharp;
+	float doGauss;
+	float gaussVal;
+	float doBoxBlur;
+	float doRecursiveGauss;
+};
+
+static const FilterPresetEntry filterPresets[] = {
+	{ 'Z', "luminance 0.333 R + 0.333 G + 0.333 B", 0.333f, 0.333f, 0.333f, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 'X', "luminance 0.299 R + 0.587 G + 0.114 B", 0.299f, 0.587f, 0.114f, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 'C', "luminance 0.213 R + 0.715 G + 0.072 B", 0.213f, 0.715f, 0.072f, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 'V', "brightness", 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+	{ 'B', "original image", 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 'S', "horizontal sobel", 1, 1, 1, 0, 1, 1, 0, 0, 0, 0, 0 },
+	{ 'A', "vertical sobel", 1, 1, 1, 0, 1, 0, 0, 0, 0, 0, 0 },
+	{ 'D', "unsharp mask", 1, 1, 1, 0, 0, 0, 1, 0, 0, 0, 0 },
+	{ 'L', "gauss 3x3", 1, 1, 1, 0, 0, 0, 0, 1, 3, 0, 0 },
+	{ 'K', "gauss 5x5", 1, 1, 1, 0, 0, 0, 0, 1, 5, 0, 0 },
+	{ 'J', "gauss 7x7", 1, 1, 1, 0, 0, 0, 0, 1, 7, 0, 0 },
+	{ 'H', "stacked box blur 7x7", 1, 1, 1, 0, 0, 0, 0, 0, 7, 1, 0 },
+	{ 'G', "recursive gauss 7x7", 1, 1, 1, 0, 0, 0, 0, 0, 7, 0, 1 },
+};
+
+static const FilterPresetEntry *FindPreset(char key)
+{
+	key = (char)toupper((unsigned char)key);
+	for (const FilterPresetEntry &entry : filterPresets) {
+		if (entry.key == key) return &entry;
+	}
+	return nullptr;
+}
+
+bool FilterPreset(char key, FilterParams *params)
+{
+	const FilterPresetEntry *entry = FindPreset(key);
+	if (!entry) return false;
+
+	params->luminanceValues.r = entry->r;
+	params->luminanceValues.g = entry->g;
+	params->luminanceValues.b = entry->b;
+	params->adjustBrightness = entry->adjustBrightness;
+	params->doSobel = entry->doSobel;
+	params->horSobel = entry->horSobel;
+	params->doUnSharp = entry->doUnSharp;
+	params->doGauss = entry->doGauss;
+	params->gaussVal = entry->gaussVal;
+	params->gaussSigma = 0;
+	params->doBoxBlur = entry->doBoxBlur;
+	params->doRecursiveGauss = entry->doRecursiveGauss;
+	return true;
+}
+
+const char *FilterPresetName(char key)
+{
+	const FilterPresetEntry *entry = FindPreset(key);
+	return entry ? entry->name : "unknown";
+}
+
+// --------------------------------------------------------------------------
+// Image storage
+
+MyImage::MyImage() : width(0), height(0)
+	{}
+
+void InitializeImage(MyImage *image, int width, int height)
+{
+	image->width = width;
+	image->height = height;
+	image->pixels.resize((size_t)width * height * 4);
+}
+
+// 8-bit components to floating point RGBA
+static void ConvertRow(const unsigned char *in, int width, int components, float *out)
+{
+	const float scale = 1.0f / 255.0f;
+	for (int x = 0; x < width; x++, in += components, out += 4) {
+		out[0] = in[0] * scale;
+		out[1] = components > 1 ? in[1] * scale : 0.0f;
+		out[2] = components > 2 ? in[2] * scale : 0.0f;
+		out[3] = components > 3 ? in[3] * scale : 1.0f;
+	}
+}
+
+bool InitializeImage(MyImage *image, const MyPixels &pixels)
+{
+	int components = pixels.components;
+	if (pixels.data == nullptr || components < 1 || components > 4) {
+		cout << "Invalid image format" << endl;
+		return false;
+	}
+
+	InitializeImage(image, pixels.width, pixels.height);
+	ParallelRows(pixels.height, [&](int first, int end) {
+		for (int y = first; y < end; y++) {
+			ConvertRow(pixels.data + (size_t)y * pixels.width * components, pixels.width, components,
+					   &image->pixels[(size_t)y * pixels.width * 4]);
+		}
+	});
+	return true;
+}
+
+bool LoadImage(MyImage *image, const char *filename)
+{
+	// a PNG goes row by row from the file into the image
+	int components = 0;
+	auto start = [&](int width, int height, int rowComponents) {
+		InitializeImage(image, width, height);
+		components = rowComponents;
+		return true;
+	};
+	auto row = [&](int y, const unsigned char *in) {
+		ConvertRow(in, image->width, components, &image->pixels[(size_t)y * image->width * 4]);
+	};
+	if (IsPngPath(filename) && StreamPngRows(filename, start, row)) return true;
+
+	MyPixels pixels;
+	if (!DecodePixels(&pixels, filename)) {
+		cout << "failed to load image " << filename << endl;
+		return false;
+	}
+	bool result = InitializeImage(image, pixels);
+	DestroyPixels(&pixels);
+	return result;
+}
+
+void StoreImage(const MyImage &image, vector<unsigned char> *bytes, int components)
+{
+	bytes->resize((size_t)image.width * image.height * components);
+	ParallelRows(image.height, [&](int first, int end) {
+		for (int y = first; y < end; y++) {
+			const float *in = &image.pixels[(size_t)y * image.width * 4];
+			unsigned char *out = &(*bytes)[(size_t)y * image.width * components];
+			for (int x = 0; x < image.width; x++, in += 4) {
+				for (int c = 0; c < components; c++) {
+					float v = min(max(in[c], 0.0f), 1.0f);
+					*out++ = (unsigned char)(v * 255.0f + 0.5f);
+				}
+			}
+		}
+	});
+}
+
+// bands ParallelRows() may use on this thread, 0 for one per hardware thread
+static thread_local int bandLimit = 0;
+
+void LimitParallelRows(int bands)
+{
+	bandLimit = max(bands, 0);
+}
+
+// the helper threads of one calling thread; helper i runs band i of every
+// call that has that many
+struct RowWorkers
+{
+	std::mutex mutex;
+	condition_variable start;
+	condition_variable finished;
+	vector<thread> threads;
+	unsigned calls;			// a new value hands out the next bands
+	bool stopping;
+
+	// the call in progress
+	int height;
+	int bands;
+	int remaining;			// bands the helpers have not finished
+	const void *fn;
+	void (*run)(const void *, int, int);
+
+	RowWorkers() : calls(0), stopping(false), height(0), bands(0), remaining(0), fn(nullptr), run(nullptr) {}
+
+	// joins the helpers when the thread that owns them ends
+	~RowWorkers()
+	{
+		{
+			lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		start.notify_all();
+		for (thread &worker : threads) worker.join();
+	}
+};
+
+// whether this thread is running a band, on a helper or the calling thread
+static thread_local bool inRowBand = false;
+
+static void RowWorker(RowWorkers *workers, int band, unsigned calls)
+{
+	unique_lock<mutex> lock(workers->mutex);
+	for (;;) {
+		workers->start.wait(lock, [&]() { return workers->stopping || workers->calls != calls; });
+		if (workers->stopping) return;
+		calls = workers->calls;
+		if (band >= workers->bands) continue;
+
+		int height = workers->height, bands = workers->bands;
+		lock.unlock();
+		inRowBand = true;
+		workers->run(workers->fn, height * band / bands, height * (band + 1) / bands);
+		inRowBand = false;
+		lock.lock();
+		if (--workers->remaining == 0) workers->finished.notify_one();
+	}
+}
+
+void RunRowBands(int height, const void *fn, void (*run)(const void *, int, int))
+{
+	static thread_local RowWorkers workers;
+	int threads = bandLimit > 0 ? bandLimit : (int)max(1u, thread::hardware_concurrency());
+	int bands = min(threads, height);
+
+	// a band that splits its rows again runs them itself, on whichever
+	// thread it is, rather than starting helpers of its own
+	if (bands <= 1 || inRowBand) {
+		if (height > 0) run(fn, 0, height);
+		return;
+	}
+
+	// only this thread changes calls, so new helpers can read it unlocked
+	while ((int)workers.threads.size() < bands - 1) {
+		workers.threads.emplace_back(RowWorker, &workers, (int)workers.threads.size() + 1, workers.calls);
+	}
+	{
+		lock_guard<mutex> lock(workers.mutex);
+		workers.height = height;
+		workers.bands = bands;
+		workers.remaining = bands - 1;
+		workers.fn = fn;
+		workers.run = run;
+		workers.calls++;
+	}
+	workers.start.notify_all();
+
+	inRowBand = true;
+	run(fn, 0, height / bands);
+	inRowBand = false;
+	unique_lock<mutex> lock(workers.mutex);
+	workers.finished.wait(lock, [&]() { return workers.remaining == 0; });
+}
+
+// --------------------------------------------------------------------------
+// Convolution support
+
+// one texel fetch of a kernel, offset from the centre texel
+struct Tap
+{
+	int dx;
+	int dy;
+	float weight;
+};
+
+// copies src into padded with a border of edge texels, so kernels of up to
+// that radius never need to clamp their coordinates
+static void PadImage(const MyImage &src, int border, MyImage *padded)
+{
+	InitializeImage(padded, src.width + 2 * border, src.height + 2 * border);
+	ParallelRows(padded->height, [&](int first, int end) {
+		for (int y = first; y < end; y++) {
+			int sy = min(max(y - border, 0), src.height - 1);
+			const float *in = &src.pixels[(size_t)sy * src.width * 4];
+			float *out = &padded->pixels[(size_t)y * padded->width * 4];
+
+			for (int x = 0; x < border; x++) memcpy(out + x * 4, in, 4 * sizeof(float));
+			memcpy(out + border * 4, in, (size_t)src.width * 4 * sizeof(float));
+			const float *last = in + (src.width - 1) * 4;
+			for (int x = border + src.width; x < padded->width; x++) memcpy(out + x * 4, last, 4 * sizeof(float));
+		}
+	});
+}
+
+// the most taps Convolve() takes, a full 3x3 kernel
+const int MAX_TAPS = 9;
+
+// weighted sum of the taps at every pixel, padding src into padded first
+static void Convolve(const MyImage &src, MyImage *dst, const Tap *taps, int count, MyImage *padded)
+{
+	int border = 0;
+	for (int i = 0; i < count; i++) border = max(border, max(abs(taps[i].dx), abs(taps[i].dy)));
+
+	PadImage(src, border, padded);
+	InitializeImage(dst, src.width, src.height);
+
+	ptrdiff_t offsets[MAX_TAPS];
+	float weights[MAX_TAPS];
+	for (int i = 0; i < count; i++) {
+		offsets[i] = ((ptrdiff_t)taps[i].dy * padded->width + taps[i].dx) * 4;
+		weights[i] = taps[i].weight;
+	}
+
+	ParallelRows(src.height, [&](int first, int end) {
+		for (int y = first; y < end; y++) {
+			const float *in = &padded->pixels[((size_t)(y + border) * padded->width + border) * 4];
+			float *out = &dst->pixels[(size_t)y * dst->width * 4];
+			for (int x = 0; x < src.width; x++, in += 4, out += 4) {
+				Pixel sum = SplatPixel(0.0f);
+				for (int i = 0; i < count; i++) {
+					sum = MulAddPixel(sum, LoadPixel(in + offsets[i]), SplatPixel(weights[i]));
+				}
+				StorePixel(out, ClampPixel(sum));
+			}
+		}
+	});
+}
+
+// applies a 3x3 kernel laid out like regKernel[] in the shader
+static void Convolve3x3(const MyImage &src, MyImage *dst, const float kernel[9], FilterScratch *scratch)
+{
+	Tap taps[MAX_TAPS];
+	int count = 0;
+	for (int i = 0; i < 9; i++) {
+		if (kernel[i] == 0.0f) continue;
+		Tap tap = { i % 3 - 1, i / 3 - 1, kernel[i] };
+		taps[count++] = tap;
+	}
+
+	FilterScratch local;
+	Convolve(src, dst, taps, count, &(scratch ? scratch : &local)->passes[0]);
+}
+
+// replaces red, green and blue with their weighted sum, keeping alpha
+static void WeightedGrey(const MyImage &src, MyImage *dst, float r, float g, float b)
+{
+	InitializeImage(dst, src.width, src.height);
+	ParallelRows(src.height, [&](int first, int end) {
+		const Pixel weights = SetPixel(r, g, b, 0.0f);
+		size_t begin = (size_t)first * src.width * 4;
+		size_t stop = (size_t)end * src.width * 4;
+		for (size_t i = begin; i < stop; i += 4) {
+			Pixel colour = LoadPixel(&src.pixels[i]);
+			StorePixel(&dst->pixels[i], ClampPixel(KeepAlpha(Dot3Pixel(colour, weights), colour)));
+		}
+	});
+}
+
+// symmetric 1D kernel along rows then along columns, through tmp; effect
+// makes the result opaque and clamped like the final pass of blur.glsl
+static void SeparableBlur(const MyImage &src, MyImage *dst, const vector<float> &weights, bool effect, MyImage *tmp)
+{
+	int radius = (int)weights.size() - 1;
+	int width = src.width;
+	int height = src.height;
+
+	// horizontal pass into tmp, each thread padding its own rows into a
+	// buffer it keeps for the next image
+	InitializeImage(tmp, width, height);
+	ParallelRows(height, [&](int first, int end) {
+		static thread_local vector<float> row;
+		row.resize((size_t)(width + 2 * radius) * 4);
+		for (int y = first; y < end; y++) {
+			const float *in = &src.pixels[(size_t)y * width * 4];
+			for (int x = 0; x < width + 2 * radius; x++) {
+				int sx = min(max(x - radius, 0), width - 1);
+				memcpy(&row[(size_t)x * 4], in + sx * 4, 4 * sizeof(float));
+			}
+
+			float *out = &tmp->pixels[(size_t)y * width * 4];
+			const float *centre = &row[(size_t)radius * 4];
+			for (int x = 0; x < width; x++, centre += 4) {
+				Pixel sum = MulPixel(LoadPixel(centre), SplatPixel(weights[0]));
+				for (int i = 1; i <= radius; i++) {
+					Pixel pair = AddPixel(LoadPixel(centre - i * 4), LoadPixel(centre + i * 4));
+					sum = MulAddPixel(sum, pair, SplatPixel(weights[i]));
+				}
+				StorePixel(out + x * 4, sum);
+			}
+		}
+	});
+
+	// vertical pass a whole row at a time, so every tap streams through memory
+	InitializeImage(dst, width, height);
+	ParallelRows(height, [&](int first, int end) {
+		const Pixel one = SplatPixel(1.0f);
+		static thread_local vector<const float *> above, below;
+		above.resize(radius + 1);
+		below.resize(radius + 1);
+		for (int y = first; y < end; y++) {
+			for (int i = 0; i <= radius; i++) {
+				above[i] = &tmp->pixels[(size_t)max(y - i, 0) * width * 4];
+				below[i] = &tmp->pixels[(size_t)min(y + i, height - 1) * width * 4];
+			}
+
+			float *out = &dst->pixels[(size_t)y * width * 4];
+			for (int x = 0; x < width * 4; x += 4) {
+				Pixel sum = MulPixel(LoadPixel(above[0] + x), SplatPixel(weights[0]));
+				for (int i = 1; i <= radius; i++) {
+					Pixel pair = AddPixel(LoadPixel(above[i] + x), LoadPixel(below[i] + x));
+					sum = MulAddPixel(sum, pair, SplatPixel(weights[i]));
+				}
+				if (effect) sum = ClampPixel(KeepAlpha(sum, one));
+				StorePixel(out + x, sum);
+			}
+		}
+	});
+}
+
+// --------------------------------------------------------------------------
+// Effects
+
+void Luminance(const MyImage &src, MyImage *dst, const LuminanceValues &values)
+{
+	WeightedGrey(src, dst, values.r, values.g, values.b);
+}
+
+void Brightness(const MyImage &src, MyImage *dst)
+{
+	WeightedGrey(src, dst, 0.1f, 0.1f, 0.1f);
+}
+
+void Sobel(const MyImage &src, MyImage *dst, bool horizontal, FilterScratch *scratch)
+{
+	static const float horizontalKernel[9] = {
+		-1.0f, -2.0f, -1.0f,
+		 0.0f,  0.0f,  0.0f,
+		 1.0f,  2.0f,  1.0f
+	};
+	static const float verticalKernel[9] = {
+		1.0f, 0.0f, -1.0f,
+		2.0f, 0.0f, -2.0f,
+		1.0f, 0.0f, -1.0f
+	};
+	Convolve3x3(src, dst, horizontal ? horizontalKernel : verticalKernel, scratch);
+}
+
+void UnSharpen(const MyImage &src, MyImage *dst, FilterScratch *scratch)
+{
+	static const float kernel[9] = {
+		 0.0f, -1.0f,  0.0f,
+		-1.0f,  5.0f, -1.0f,
+		 0.0f, -1.0f,  0.0f
+	};
+	Convolve3x3(src, dst, kernel, scratch);
+}
+
+void Gauss(const MyImage &src, MyImage *dst, float sigma, FilterScratch *scratch)
+{
+	static thread_local vector<float> weights;
+	GaussianKernel(sigma, &weights);
+	FilterScratch local;
+	SeparableBlur(src, dst, weights, true, &(scratch ? scratch : &local)->passes[0]);
+}
+
+void GaussianKernel(float sigma, vector<float> *weights)
+{
+	// a zero sigma would divide by zero; this narrow it is the identity
+	sigma = max(sigma, MIN_GAUSS_SIGMA);
+	int radius = max(1, (int)ceil(3.0f * sigma));
+	weights->resize(radius + 1);
+
+	float sum = 0.0f;
+	for (int i = 0; i <= radius; i++) {
+		(*weights)[i] = exp(-0.5f * i * i / (sigma * sigma));
+		sum += i == 0 ? (*weights)[i] : 2.0f * (*weights)[i];
+	}
+	for (float &weight : *weights) weight /= sum;
+}
+
+void GaussianBlur(const MyImage &src, MyImage *dst, float sigma, FilterScratch *scratch)
+{
+	static thread_local vector<float> weights;
+	GaussianKernel(sigma, &weights);
+	FilterScratch local;
+	SeparableBlur(src, dst, weights, false, &(scratch ? scratch : &local)->passes[0]);
+}
+
+// box pass along each row with clamp-to-edge running sums: add the texel
+// entering the window, drop the one leaving it
+static void BoxRows(const MyImage &src, MyImage *dst, int radius)
+{
+	int width = src.width;
+	InitializeImage(dst, width, src.height);
+	ParallelRows(src.height, [&](int first, int end) {
+		const Pixel scale = SplatPixel(1.0f / (2 * radius + 1));
+		for (int y = first; y < end; y++) {
+			const float *in = &src.pixels[(size_t)y * width * 4];
+			float *out = &dst->pixels[(size_t)y * width * 4];
+
+			Pixel sum = MulPixel(LoadPixel(in), SplatPixel((float)radius + 1));
+			for (int x = 1; x <= radius; x++) {
+				sum = AddPixel(sum, LoadPixel(in + min(x, width - 1) * 4));
+			}
+			for (int x = 0; x < width; x++) {
+				StorePixel(out + x * 4, MulPixel(sum, scale));
+				const float *entering = in + min(x + radius + 1, width - 1) * 4;
+				const float *leaving = in + max(x - radius, 0) * 4;
+				sum = AddPixel(sum, SubPixel(LoadPixel(entering), LoadPixel(leaving)));
+			}
+		}
+	});
+}
+
+// the same down each column, keeping one running sum per column so that
+// every step reads whole rows; effect makes the result opaque and clamped
+static void BoxColumns(const MyImage &src, MyImage *dst, int radius, bool effect)
+{
+	int width = src.width;
+	int height = src.height;
+	InitializeImage(dst, width, height);
+	ParallelRows(width, [&](int first, int end) {
+		const Pixel scale = SplatPixel(1.0f / (2 * radius + 1));
+		const Pixel one = SplatPixel(1.0f);
+		static thread_local vector<float> sums;
+		sums.resize((size_t)(end - first) * 4);
+		auto row = [&](int y) { return &src.pixels[((size_t)min(max(y, 0), height - 1) * width + first) * 4]; };
+
+		for (int x = 0; x < end - first; x++) {
+			Pixel sum = MulPixel(LoadPixel(row(0) + x * 4), SplatPixel((float)radius + 1));
+			for (int y = 1; y <= radius; y++) sum = AddPixel(sum, LoadPixel(row(y) + x * 4));
+			StorePixel(&sums[x * 4], sum);
+		}
+		for (int y = 0; y < height; y++) {
+			const float *entering = row(y + radius + 1);
+			const float *leaving = row(y - radius);
+			float *out = &dst->pixels[((size_t)y * width + first) * 4];
+			for (int x = 0; x < (end - first) * 4; x += 4) {
+				Pixel sum = LoadPixel(&sums[x]);
+				Pixel mean = MulPixel(sum, scale);
+				if (effect) mean = ClampPixel(KeepAlpha(mean, one));
+				StorePixel(out + x, mean);
+				StorePixel(&sums[x], AddPixel(sum, SubPixel(LoadPixel(entering + x), LoadPixel(leaving + x))));
+			}
+		}
+	});
+}
+
+void BoxBlur(const MyImage &src, MyImage *dst, int radius, FilterScratch *scratch)
+{
+	FilterScratch local;
+	MyImage &tmp = (scratch ? scratch : &local)->passes[0];
+	BoxRows(src, &tmp, radius);
+	BoxColumns(tmp, dst, radius, false);
+}
+
+void StackedBoxBlur(const MyImage &src, MyImage *dst, float sigma, FilterScratch *scratch)
+{
+	// box widths whose three-fold convolution has variance sigma^2: m boxes
+	// of the odd width below the ideal one, the rest two texels wider
+	const int passes = 3;
+	float ideal = sqrt(12.0f * sigma * sigma / passes + 1.0f);
+	int lower = (int)floor(ideal);
+	if (lower % 2 == 0) lower--;
+	int upper = lower + 2;
+	float mIdeal = (12.0f * sigma * sigma - passes * lower * lower - 4.0f * passes * lower - 3.0f * passes) / (-4.0f * lower - 4.0f);
+	int m = (int)floor(mIdeal + 0.5f);
+
+	FilterScratch local;
+	if (!scratch) scratch = &local;
+	MyImage &a = scratch->passes[0], &b = scratch->passes[1];
+	const MyImage *in = &src;
+	for (int i = 0; i < passes; i++) {
+		int radius = ((i < m ? lower : upper) - 1) / 2;
+		bool last = i == passes - 1;
+		BoxRows(*in, &a, radius);
+		BoxColumns(a, last ? dst : &b, radius, last);
+		in = &b;
+	}
+}
+
+// copies src into dst with rows and columns swapped, a block of pixels at a
+// time so both the reads and the writes stay within a few cache lines
+static void TransposeImage(const MyImage &src, MyImage *dst)
+{
+	const int block = 16;
+	InitializeImage(dst, src.height, src.width);
+	int blockRows = (src.height + block - 1) / block;
+	ParallelRows(blockRows, [&](int first, int end) {
+		for (int by = first * block; by < min(end * block, src.height); by += block) {
+			for (int bx = 0; bx < src.width; bx += block) {
+				for (int y = by; y < min(by + block, src.height); y++) {
+					for (int x = bx; x < min(bx + block, src.width); x++) {
+						const float *in = &src.pixels[((size_t)y * src.width + x) * 4];
+						StorePixel(&dst->pixels[((size_t)x * src.height + y) * 4], LoadPixel(in));
+					}
+				}
+			}
+		}
+	});
+}
+
+// Triggs and Sdika, "Boundary conditions for Young-van Vliet recursive
+// filtering" (IEEE Trans. Signal Processing, 2006): with the edge value
+// continued forever, the first three anti-causal outputs are the edge value
+// plus M times the last three causal outputs' deviations from it. M is found
+// here by running both passes over a long enough constant continuation.
+static void BoundaryMatrix(double B, double b1, double b2, double b3, float sigma, float M[9])
+{
+	int length = (int)(10 * sigma) + 50;
+	static thread_local vector<double> causal;
+	causal.resize(length);
+	for (int j = 0; j < 3; j++) {
+		// unit deviation of causal output N-1-j, with an edge value of 0
+		double w[3] = { 0, 0, 0 };
+		w[j] = 1;
+
+		double p1 = w[0], p2 = w[1], p3 = w[2];
+		for (int k = 0; k < length; k++) {
+			causal[k] = b1 * p1 + b2 * p2 + b3 * p3;
+			p3 = p2;
+			p2 = p1;
+			p1 = causal[k];
+		}
+
+		double q1 = 0, q2 = 0, q3 = 0;
+		for (int k = length - 1; k >= 0; k--) {
+			double v = B * causal[k] + b1 * q1 + b2 * q2 + b3 * q3;
+			q3 = q2;
+			q2 = q1;
+			q1 = v;
+		}
+		for (int i = 0; i < 3; i++) {
+			double v = B * w[i] + b1 * q1 + b2 * q2 + b3 * q3;
+			q3 = q2;
+			q2 = q1;
+			q1 = v;
+			M[i * 3 + j] = (float)v;
+		}
+	}
+}
+
+// forward then backward third-order recursion along every row, in place
+static void RecursiveRows(MyImage *image, float sigma, bool effect)
+{
+	// coefficients from Young and van Vliet, "Recursive implementation of
+	// the Gaussian filter" (Signal Processing, 1995)
+	sigma = max(sigma, 0.5f);
+	float q = sigma >= 2.5f ? 0.98711f * sigma - 0.96330f
+							: 3.97156f - 4.14554f * sqrt(1.0f - 0.26891f * sigma);
+	float q2 = q * q;
+	float q3 = q2 * q;
+	float b0 = 1.57825f + 2.44413f * q + 1.4281f * q2 + 0.422205f * q3;
+	float b1 = (2.44413f * q + 2.85619f * q2 + 1.26661f * q3) / b0;
+	float b2 = -(1.4281f * q2 + 1.26661f * q3) / b0;
+	float b3 = 0.422205f * q3 / b0;
+	float B = 1.0f - (b1 + b2 + b3);
+
+	float M[9];
+	BoundaryMatrix(B, b1, b2, b3, sigma, M);
+
+	int width = image->width;
+	ParallelRows(image->height, [&](int first, int end) {
+		const Pixel vB = SplatPixel(B), v1 = SplatPixel(b1), v2 = SplatPixel(b2), v3 = SplatPixel(b3);
+		const Pixel one = SplatPixel(1.0f);
+		for (int y = first; y < end; y++) {
+			float *row = &image->pixels[(size_t)y * width * 4];
+			Pixel edge = LoadPixel(row + (width - 1) * 4);
+
+			// start in the steady state of a constant edge (clamp-to-edge)
+			Pixel w1 = LoadPixel(row), w2 = w1, w3 = w1;
+			for (int x = 0; x < width; x++) {
+				Pixel w = MulPixel(LoadPixel(row + x * 4), vB);
+				w = MulAddPixel(MulAddPixel(MulAddPixel(w, w1, v1), w2, v2), w3, v3);
+				StorePixel(row + x * 4, w);
+				w3 = w2;
+				w2 = w1;
+				w1 = w;
+			}
+
+			Pixel y1, y2, y3;
+			int x = width - 1;
+			if (width >= 3) {
+				// the last three outputs follow from the last three causal outputs
+				Pixel d0 = SubPixel(w1, edge), d1 = SubPixel(w2, edge), d2 = SubPixel(w3, edge);
+				y3 = MulAddPixel(MulAddPixel(MulAddPixel(edge, d0, SplatPixel(M[0])), d1, SplatPixel(M[1])), d2, SplatPixel(M[2]));
+				y2 = MulAddPixel(MulAddPixel(MulAddPixel(edge, d0, SplatPixel(M[3])), d1, SplatPixel(M[4])), d2, SplatPixel(M[5]));
+				y1 = MulAddPixel(MulAddPixel(MulAddPixel(edge, d0, SplatPixel(M[6])), d1, SplatPixel(M[7])), d2, SplatPixel(M[8]));
+				StorePixel(row + (width - 1) * 4, effect ? ClampPixel(KeepAlpha(y3, one)) : y3);
+				StorePixel(row + (width - 2) * 4, effect ? ClampPixel(KeepAlpha(y2, one)) : y2);
+				StorePixel(row + (width - 3) * 4, effect ? ClampPixel(KeepAlpha(y1, one)) : y1);
+				x = width - 4;
+			} else {
+				y1 = y2 = y3 = w1;
+			}
+
+			for (; x >= 0; x--) {
+				Pixel v = MulPixel(LoadPixel(row + x * 4), vB);
+				v = MulAddPixel(MulAddPixel(MulAddPixel(v, y1, v1), y2, v2), y3, v3);
+				y3 = y2;
+				y2 = y1;
+				y1 = v;
+				if (effect) v = ClampPixel(KeepAlpha(v, one));
+				StorePixel(row + x * 4, v);
+			}
+		}
+	});
+}
+
+void RecursiveGauss(const MyImage &src, MyImage *dst, float sigma, FilterScratch *scratch)
+{
+	FilterScratch local;
+	MyImage &transposed = (scratch ? scratch : &local)->passes[0];
+	TransposeImage(src, &transposed);
+	RecursiveRows(&transposed, sigma, false);		// columns of src
+	TransposeImage(transposed, dst);
+	RecursiveRows(dst, sigma, true);
+}
+
+void DownsampleImage(const MyImage &src, MyImage *dst)
+{
+	int width = max(src.width / 2, 1);
+	int height = max(src.height / 2, 1);
+	InitializeImage(dst, width, height);
+	ParallelRows(height, [&](int first, int end) {
+		const Pixel quarter = SplatPixel(0.25f);
+		for (int y = first; y < end; y++) {
+			const float *top = &src.pixels[(size_t)(2 * y) * src.width * 4];
+			const float *bottom = &src.pixels[(size_t)min(2 * y + 1, src.height - 1) * src.width * 4];
+			float *out = &dst->pixels[(size_t)y * width * 4];
+			for (int x = 0; x < width; x++) {
+				int left = 2 * x * 4;
+				int right = min(2 * x + 1, src.width - 1) * 4;
+				Pixel sum = AddPixel(AddPixel(LoadPixel(top + left), LoadPixel(top + right)),
+									 AddPixel(LoadPixel(bottom + left), LoadPixel(bottom + right)));
+				StorePixel(out + x * 4, MulPixel(sum, quarter));
+			}
+		}
+	});
+}
+
+void BuildMipChain(const MyImage &image, vector<MyImage> *levels)
+{
+	int count = 0;
+	while ((max(image.width, image.height) >> (count + 1)) > 0) count++;
+
+	levels->assign(count, MyImage());
+	for (int i = 0; i < count; i++) {
+		DownsampleImage(i == 0 ? image : (*levels)[i - 1], &(*levels)[i]);
+	}
+}
+
+void ApplyFilter(const MyImage &src, MyImage *dst, const FilterParams &params, FilterScratch *scratch)
+{
+	switch (SelectEffect(params)) {
+		case EFFECT_LUMINANCE:
+			Luminance(src, dst, params.luminanceValues);
+			break;
+		case EFFECT_BRIGHTNESS:
+			Brightness(src, dst);
+			break;
+		case EFFECT_SOBEL:
+			Sobel(src, dst, params.horSobel > 0, scratch);
+			break;
+		case EFFECT_UNSHARP:
+			UnSharpen(src, dst, scratch);
+			break;
+		case EFFECT_GAUSS:
+			Gauss(src, dst, GaussSigma(params), scratch);
+			break;
+		case EFFECT_BOXBLUR:
+			StackedBoxBlur(src, dst, GaussSigma(params), scratch);
+			break;
+		case EFFECT_RECURSIVE_GAUSS:
+			RecursiveGauss(src, dst, GaussSigma(params), scratch);
+			break;
+		case EFFECT_ORIGINAL:
+			if (dst != &src) *dst = src;
+			break;
+	}
+}
+
+double FilterThroughput(const MyImage &src, const FilterParams &params, int runs)
+{
+	MyImage dst;
+	FilterScratch scratch;
+	ApplyFilter(src, &dst, params, &scratch);		// warm up and allocate
+
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < runs; i++) {
+		ApplyFilter(src, &dst, params, &scratch);
+	}
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	double megapixels = (double)src.width * src.height * runs / 1e6;
+	return megapixels / max(elapsed.count(), 1e-9);
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include <vector>
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// CPU implementation of the effects in shaders/fragment.glsl
+//
+// Images are stored as RGBA floats in the same row order as the texture
+// (row 0 is the first row handed to glTexImage2D), so the +/- one texel
+// offsets used here are the regOffset[] table of the shader. Samples outside
+// the image are clamped to the edge like GL_CLAMP_TO_EDGE, and results are
+// clamped to [0, 1] like the 8-bit framebuffer the shader renders into.
+//
+// Rendered 1:1 into an 8-bit target the shader and ApplyFilter() agree to
+// within one step (1/255) per channel; the only differences are float
+// rounding in the weighted sums.
+
+struct LuminanceValues
+{
+	float r;
+	float g;
+	float b;
+};
+
+// the uniforms fragment.glsl reads to choose and configure an effect
+struct FilterParams
+{
+	LuminanceValues luminanceValues;
+	float adjustBrightness;
+	float doSobel;
+	float horSobel;
+	float doUnSharp;
+	float doGauss;
+	float gaussVal;
+	float gaussSigma;	// 0 uses the sigma matching gaussVal
+	float doBoxBlur;	// gauss approximated by stacked box blurs
+	float doRecursiveGauss;	// gauss approximated by a recursive filter
+
+	// initialize to the original image (no effect)
+	FilterParams();
+};
+
+enum FilterEffect
+{
+	EFFECT_ORIGINAL,
+	EFFECT_LUMINANCE,
+	EFFECT_BRIGHTNESS,
+	EFFECT_SOBEL,
+	EFFECT_UNSHARP,
+	EFFECT_GAUSS,
+	EFFECT_BOXBLUR,
+	EFFECT_RECURSIVE_GAUSS
+};
+
+// picks the effect the same way the shader variant is chosen: luminance
+// first, then brightness, sobel, unsharp mask and the blurs
+FilterEffect SelectEffect(const FilterParams &params);
+
+// standard deviation of the Gaussian blur the parameters ask for; the
+// gaussVal presets map to the sigma with the same spread as the raised-cosine
+// disc of radius gaussVal the shader used to apply
+float GaussSigma(const FilterParams &params);
+
+// fills in the parameters KeyCallback sets for an effect key (Z, X, C, V, B,
+// S, A, D, L, K, J, H, G), returning false for any other key
+bool FilterPreset(char key, FilterParams *params);
+const char *FilterPresetName(char key);
+
+struct MyImage
+{
+	int width;
+	int height;
+	std::vector<float> pixels;	// 4 floats per pixel, rows packed
+
+	// initialize to an empty image
+	MyImage();
+};
+
+void InitializeImage(MyImage *image, int width, int height);
+
+// expands decoded pixels to RGBA the way the texture unit does
+// (missing green/blue read as 0, missing alpha reads as 1)
+bool InitializeImage(MyImage *image, const MyPixels &pixels);
+bool LoadImage(MyImage *image, const char *filename);
+
+// converts back to 8-bit pixels with the given number of components
+void StoreImage(const MyImage &image, std::vector<unsigned char> *bytes, int components);
+
+// runs fn(firstRow, endRow) over bands of rows, one band per hardware thread
+// (also used to split columns into bands). The first band runs on the calling
+// thread and the others on helper threads it starts on first use and keeps
+// until it ends, so calling again starts no threads.
+template <typename Fn> void ParallelRows(int height, const Fn &fn);
+
+// ParallelRows() for a type-erased fn, which it passes back to run
+void RunRowBands(int height, const void *fn, void (*run)(const void *fn, int first, int end));
+
+// caps the bands ParallelRows() splits work into when called from this
+// thread, so several threads filtering at once do not each start one per
+// hardware thread; 0 removes the cap
+void LimitParallelRows(int bands);
+
+template <typename Fn> void ParallelRows(int height, const Fn &fn)
+{
+	RunRowBands(height, &fn, [](const void *fn, int first, int end) { (*(const Fn *)fn)(first, end); });
+}
+
+// intermediate images of the effects that work in passes, to keep between
+// calls so that filtering another image no larger allocates nothing; without
+// one each call makes its own
+struct FilterScratch
+{
+	MyImage passes[2];
+};
+
+// --------------------------------------------------------------------------
+// Effects, named after their counterparts in fragment.glsl
+
+void Luminance(const MyImage &src, MyImage *dst, const LuminanceValues &values);
+void Brightness(const MyImage &src, MyImage *dst);
+void Sobel(const MyImage &src, MyImage *dst, bool horizontal, FilterScratch *scratch = nullptr);
+void UnSharpen(const MyImage &src, MyImage *dst, FilterScratch *scratch = nullptr);
+void Gauss(const MyImage &src, MyImage *dst, float sigma, FilterScratch *scratch = nullptr);
+
+// narrowest sigma a kernel is made for; below it every weight but the
+// centre's rounds to zero
+const float MIN_GAUSS_SIGMA = 0.05f;
+
+// normalized weights of a Gaussian from the centre tap outwards, covering
+// three standard deviations (the kernel is mirrored about weights[0]);
+// sigmas below MIN_GAUSS_SIGMA, zero included, give the identity
+void GaussianKernel(float sigma, std::vector<float> *weights);
+
+// separable Gaussian: one pass along rows, one along columns, so the cost
+// grows linearly with the radius; unlike Gauss() the alpha channel is blurred
+// and nothing is clamped, so it can feed further filtering
+void GaussianBlur(const MyImage &src, MyImage *dst, float sigma, FilterScratch *scratch = nullptr);
+
+// mean of the (2 * radius + 1) texel square around each pixel, using running
+// sums so the cost per pixel does not depend on the radius
+void BoxBlur(const MyImage &src, MyImage *dst, int radius, FilterScratch *scratch = nullptr);
+
+// three box blurs sized to approximate a Gaussian of the given sigma, at a
+// constant cost per pixel for any sigma; opaque and clamped like Gauss()
+void StackedBoxBlur(const MyImage &src, MyImage *dst, float sigma, FilterScratch *scratch = nullptr);
+
+// Young-van Vliet recursive Gaussian: a third-order causal and anti-causal
+// filter along rows, then along columns through cache-blocked transposes.
+// The cost per pixel is the same for any sigma >= 0.5, fractional or not;
+// opaque and clamped like Gauss()
+void RecursiveGauss(const MyImage &src, MyImage *dst, float sigma, FilterScratch *scratch = nullptr);
+
+// half-size image where each pixel is the mean of a 2 x 2 block, like a
+// mipmap level glGenerateMipmap makes (an odd last row or column is left
+// out); for building mipmaps without a GL context
+void DownsampleImage(const MyImage &src, MyImage *dst);
+
+// every mipmap level below image, down to 1 x 1 (levels[0] is half size)
+void BuildMipChain(const MyImage &image, std::vector<MyImage> *levels);
+
+// applies whichever effect the parameters select
+void ApplyFilter(const MyImage &src, MyImage *dst, const FilterParams &params, FilterScratch *scratch = nullptr);
+
+// megapixels per second of ApplyFilter() averaged over the given runs
+double FilterThroughput(const MyImage &src, const FilterParams &params, int runs);
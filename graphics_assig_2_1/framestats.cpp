@@ -0,0 +1,284 @@
+#include "framestats.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+static const char *timerNames[TIMER_COUNT] = {
+	"filter (GPU)",
+	"tiles (GPU)",
+	"scene (GPU)",
+	"geometry",
+	"uniforms",
+	"scene (CPU)",
+	"swap",
+	"frame"
+};
+
+// overlay bar colours, GPU timers in greens, CPU timers in blues and greys
+static const float timerColours[TIMER_COUNT][3] = {
+	{ 0.3f, 0.9f, 0.3f },
+	{ 0.6f, 0.9f, 0.2f },
+	{ 0.1f, 0.6f, 0.3f },
+	{ 0.3f, 0.6f, 1.0f },
+	{ 0.5f, 0.4f, 1.0f },
+	{ 0.2f, 0.8f, 0.9f },
+	{ 0.9f, 0.5f, 0.2f },
+	{ 0.8f, 0.8f, 0.8f }
+};
+
+// overlay scale: the full window width is two frames at 60 Hz
+static const double OVERLAY_MS = 2 * 1000.0 / 60;
+
+GpuTimerQuery::GpuTimerQuery() : query(0), pending(false)
+	{}
+
+RollingSamples::RollingSamples() : next(0)
+	{}
+
+FrameStats::FrameStats() : gpuTiming(false), activeQuery(-1), skippedQueries(0), frames(0)
+{
+	for (int &next : nextQuery) next = 0;
+	for (int i = 0; i < TIMER_COUNT; i++) {
+		cpuFrameMs[i] = 0;
+		cpuRan[i] = false;
+	}
+}
+
+static void AddSample(RollingSamples *timer, double ms)
+{
+	if (timer->samples.size() < FRAME_STATS_WINDOW) {
+		timer->samples.push_back(ms);
+	} else {
+		timer->samples[timer->next] = ms;
+		timer->next = (timer->next + 1) % FRAME_STATS_WINDOW;
+	}
+}
+
+static double ElapsedMs(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// times one clear, waiting for the result: a working timer reports no more
+// than the time that passed. llvmpipe, for one, reports hours for the first
+// pass it runs, and such a timer is not trusted for later ones either.
+static bool ProbeGpuTimer(GLuint query)
+{
+	auto start = chrono::steady_clock::now();
+	glBeginQuery(GL_TIME_ELAPSED, query);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glEndQuery(GL_TIME_ELAPSED);
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+	return nanoseconds / 1e6 <= ElapsedMs(start);
+}
+
+bool InitializeFrameStats(FrameStats *stats)
+{
+	// an implementation may have no timer at all, reporting 0 bits
+	GLint bits = 0;
+	glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &bits);
+	if (bits < MIN_GPU_TIMER_BITS) {
+		cout << "No usable GPU timer (" << bits << " bits), only CPU times are measured" << endl;
+		return false;
+	}
+
+	for (auto &ring : stats->queries) {
+		for (GpuTimerQuery &query : ring) glGenQueries(1, &query.query);
+	}
+	if (!ProbeGpuTimer(stats->queries[0][0].query)) {
+		cout << "The GPU timer is unreliable on " << glGetString(GL_RENDERER) << ", only CPU times are measured" << endl;
+		DestroyFrameStats(stats);
+		return false;
+	}
+
+	stats->gpuTiming = true;
+	return !CheckGLErrors("Initializing frame stats: ");
+}
+
+// adds the results of the queries that are ready, oldest first, without
+// waiting for any
+static void CollectGpuTimers(FrameStats *stats)
+{
+	for (int timer = 0; timer < TIMER_FIRST_CPU; timer++) {
+		for (int i = 0; i < GPU_QUERY_LATENCY; i++) {
+			GpuTimerQuery &query = stats->queries[timer][(stats->nextQuery[timer] + i) % GPU_QUERY_LATENCY];
+			if (!query.pending) continue;
+
+			GLuint available = 0;
+			glGetQueryObjectuiv(query.query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) break;
+
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(query.query, GL_QUERY_RESULT, &nanoseconds);
+			AddSample(&stats->timers[timer], nanoseconds / 1e6);
+			query.pending = false;
+		}
+	}
+}
+
+void BeginFrame(FrameStats *stats)
+{
+	if (stats->gpuTiming) CollectGpuTimers(stats);
+	for (int i = 0; i < TIMER_COUNT; i++) {
+		stats->cpuFrameMs[i] = 0;
+		stats->cpuRan[i] = false;
+	}
+	stats->frameStart = chrono::steady_clock::now();
+}
+
+void EndFrame(FrameStats *stats)
+{
+	stats->cpuFrameMs[TIMER_FRAME] = ElapsedMs(stats->frameStart);
+	stats->cpuRan[TIMER_FRAME] = true;
+	for (int timer = TIMER_FIRST_CPU; timer < TIMER_COUNT; timer++) {
+		if (stats->cpuRan[timer]) AddSample(&stats->timers[timer], stats->cpuFrameMs[timer]);
+	}
+	stats->frames++;
+}
+
+void BeginGpuTimer(FrameStats *stats, FrameTimer timer)
+{
+	if (!stats->gpuTiming || stats->activeQuery >= 0) return;
+
+	GpuTimerQuery &query = stats->queries[timer][stats->nextQuery[timer]];
+	if (query.pending) {
+		stats->skippedQueries++;
+		return;
+	}
+	glBeginQuery(GL_TIME_ELAPSED, query.query);
+	stats->activeQuery = timer;
+}
+
+void EndGpuTimer(FrameStats *stats, FrameTimer timer)
+{
+	if (stats->activeQuery != timer) return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	stats->queries[timer][stats->nextQuery[timer]].pending = true;
+	stats->nextQuery[timer] = (stats->nextQuery[timer] + 1) % GPU_QUERY_LATENCY;
+	stats->activeQuery = -1;
+}
+
+void BeginCpuTimer(FrameStats *stats, FrameTimer timer)
+{
+	stats->cpuStart[timer] = chrono::steady_clock::now();
+}
+
+void EndCpuTimer(FrameStats *stats, FrameTimer timer)
+{
+	stats->cpuFrameMs[timer] += ElapsedMs(stats->cpuStart[timer]);
+	stats->cpuRan[timer] = true;
+}
+
+const char *TimerName(FrameTimer timer)
+{
+	return timerNames[timer];
+}
+
+size_t TimerSamples(const FrameStats &stats, FrameTimer timer)
+{
+	return stats.timers[timer].samples.size();
+}
+
+double TimerAverage(const FrameStats &stats, FrameTimer timer)
+{
+	const vector<double> &samples = stats.timers[timer].samples;
+	if (samples.empty()) return 0;
+	double sum = 0;
+	for (double ms : samples) sum += ms;
+	return sum / samples.size();
+}
+
+double TimerPercentile(const FrameStats &stats, FrameTimer timer, double percentile)
+{
+	vector<double> samples = stats.timers[timer].samples;
+	if (samples.empty()) return 0;
+	size_t rank = (size_t)ceil(min(max(percentile, 0.0), 100.0) / 100 * samples.size());
+	size_t index = rank > 0 ? rank - 1 : 0;
+	nth_element(samples.begin(), samples.begin() + index, samples.end());
+	return samples[index];
+}
+
+string FrameStatsSummary(const FrameStats &stats)
+{
+	ostringstream summary;
+	summary << fixed << setprecision(2);
+	for (int timer = 0; timer < TIMER_COUNT; timer++) {
+		if (TimerSamples(stats, (FrameTimer)timer) == 0) continue;
+		if (summary.tellp() > 0) summary << "  ";
+		summary << timerNames[timer] << " " << TimerAverage(stats, (FrameTimer)timer);
+	}
+	summary << " ms";
+	return summary.str();
+}
+
+void DrawFrameStatsOverlay(const FrameStats &stats, int windowWidth)
+{
+	const int barHeight = 6, gap = 2, margin = 8;
+	double pixelsPerMs = (windowWidth - 2 * margin) / OVERLAY_MS;
+
+	GLfloat clearColour[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColour);
+	glEnable(GL_SCISSOR_TEST);
+
+	// a backdrop, with a mark where one 60 Hz frame ends
+	int height = TIMER_COUNT * (barHeight + gap) + gap;
+	glScissor(margin - gap, margin - gap, windowWidth - 2 * (margin - gap), height);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glScissor(margin + (int)(OVERLAY_MS / 2 * pixelsPerMs), margin - gap, 1, height);
+	glClearColor(0.6f, 0.1f, 0.1f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	for (int timer = 0; timer < TIMER_COUNT; timer++) {
+		if (TimerSamples(stats, (FrameTimer)timer) == 0) continue;
+		int y = margin + (TIMER_COUNT - 1 - timer) * (barHeight + gap);
+		int length = (int)min(TimerAverage(stats, (FrameTimer)timer) * pixelsPerMs, (double)windowWidth - 2 * margin);
+		int p95 = (int)min(TimerPercentile(stats, (FrameTimer)timer, 95) * pixelsPerMs, (double)windowWidth - 2 * margin - 1);
+
+		const float *colour = timerColours[timer];
+		glScissor(margin, y, max(length, 1), barHeight);
+		glClearColor(colour[0], colour[1], colour[2], 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glScissor(margin + p95, y, 1, barHeight);
+		glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+
+	// reset state to default (no scissor, the scene's clear colour)
+	glDisable(GL_SCISSOR_TEST);
+	glClearColor(clearColour[0], clearColour[1], clearColour[2], clearColour[3]);
+}
+
+void PrintFrameStats(const FrameStats &stats)
+{
+	cout << "Frame times over the last " << FRAME_STATS_WINDOW << " of " << stats.frames << " frames (ms):" << endl
+		 << "  " << left << setw(14) << "" << right << setw(9) << "mean" << setw(9) << "p50" << setw(9) << "p95"
+		 << setw(9) << "p99" << endl;
+	for (int timer = 0; timer < TIMER_COUNT; timer++) {
+		FrameTimer which = (FrameTimer)timer;
+		if (TimerSamples(stats, which) == 0) continue;
+		cout << "  " << left << setw(14) << timerNames[timer] << right << fixed << setprecision(3)
+			 << setw(9) << TimerAverage(stats, which) << setw(9) << TimerPercentile(stats, which, 50)
+			 << setw(9) << TimerPercentile(stats, which, 95) << setw(9) << TimerPercentile(stats, which, 99) << endl;
+	}
+	if (stats.skippedQueries > 0) {
+		cout << "  " << stats.skippedQueries << " GPU passes not timed while their queries were in flight" << endl;
+	}
+}
+
+void DestroyFrameStats(FrameStats *stats)
+{
+	for (auto &ring : stats->queries) {
+		for (GpuTimerQuery &query : ring) {
+			if (query.query) glDeleteQueries(1, &query.query);
+			query = GpuTimerQuery();
+		}
+	}
+	stats->gpuTiming = false;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// Per-pass frame timing: GPU time from GL_TIME_ELAPSED queries and CPU time
+// from the steady clock, kept as a rolling window of recent frames
+//
+// GPU queries are read back at the start of a later frame, once the driver
+// says their results are available, so timing never waits for the GPU. Each
+// timer has a ring of GPU_QUERY_LATENCY queries; if they are all still in
+// flight the pass is not timed that frame rather than stalling. A timer with
+// too few bits, or one that gets a single timed clear wrong at start-up, is
+// not used at all.
+
+enum FrameTimer
+{
+	// GPU time of the passes
+	TIMER_FILTER_GPU,		// the effect or blur into its render target
+	TIMER_TILES_GPU,		// tile uploads and the page table
+	TIMER_SCENE_GPU,		// drawing the image into the window
+
+	// CPU time of the main loop
+	TIMER_GEOMETRY,			// LoadGeometry()
+	TIMER_UNIFORMS,			// the transform and effect uniforms
+	TIMER_SCENE_CPU,		// issuing the draw calls of RenderScene()
+	TIMER_SWAP,				// glfwSwapBuffers(), including any wait for vsync
+	TIMER_FRAME,			// the whole frame, BeginFrame() to EndFrame()
+
+	TIMER_COUNT,
+	TIMER_FIRST_CPU = TIMER_GEOMETRY
+};
+
+// frames a GPU query may stay in flight before its timer is skipped
+const int GPU_QUERY_LATENCY = 4;
+
+// fewest bits of GPU timer used, the minimum the GL spec allows (a second
+// before the counter wraps)
+const int MIN_GPU_TIMER_BITS = 30;
+
+// samples each timer keeps (about two seconds at 60 frames a second)
+const int FRAME_STATS_WINDOW = 120;
+
+struct GpuTimerQuery
+{
+	GLuint query;
+	bool pending;		// issued and not yet read back
+
+	// initialize object names to zero (OpenGL reserved value)
+	GpuTimerQuery();
+};
+
+// the last FRAME_STATS_WINDOW samples of a timer, in milliseconds
+struct RollingSamples
+{
+	std::vector<double> samples;
+	size_t next;		// where the next sample goes once the window is full
+
+	// initialize to no samples
+	RollingSamples();
+};
+
+struct FrameStats
+{
+	RollingSamples timers[TIMER_COUNT];
+
+	// GPU timers
+	bool gpuTiming;						// false without a timer queries can trust
+	GpuTimerQuery queries[TIMER_FIRST_CPU][GPU_QUERY_LATENCY];
+	int nextQuery[TIMER_FIRST_CPU];
+	int activeQuery;					// timer with a query begun, or -1
+	unsigned skippedQueries;			// passes not timed, all queries in flight
+
+	// CPU timers, summed over the frame when a timer runs more than once
+	std::chrono::steady_clock::time_point frameStart;
+	std::chrono::steady_clock::time_point cpuStart[TIMER_COUNT];
+	double cpuFrameMs[TIMER_COUNT];
+	bool cpuRan[TIMER_COUNT];
+	unsigned frames;
+
+	// initialize to no samples and no queries
+	FrameStats();
+};
+
+// creates the queries, if the context has a GPU timer that passes the checks
+// above; the check clears the bound framebuffer and waits for the GPU once
+bool InitializeFrameStats(FrameStats *stats);
+
+// reads back the GPU queries that have finished and starts the frame's CPU
+// timers; call at the start of each drawn frame
+void BeginFrame(FrameStats *stats);
+
+// adds the frame's CPU samples, including TIMER_FRAME itself
+void EndFrame(FrameStats *stats);
+
+// GPU timers cannot overlap one another; a pass is skipped while all its
+// queries are in flight
+void BeginGpuTimer(FrameStats *stats, FrameTimer timer);
+void EndGpuTimer(FrameStats *stats, FrameTimer timer);
+
+void BeginCpuTimer(FrameStats *stats, FrameTimer timer);
+void EndCpuTimer(FrameStats *stats, FrameTimer timer);
+
+const char *TimerName(FrameTimer timer);
+
+// number of samples in the window, and their mean and percentile (0 to 100,
+// nearest rank); both are 0 without samples
+size_t TimerSamples(const FrameStats &stats, FrameTimer timer);
+double TimerAverage(const FrameStats &stats, FrameTimer timer);
+double TimerPercentile(const FrameStats &stats, FrameTimer timer, double percentile);
+
+// one line of averages of the timers with samples, e.g. for the window title
+std::string FrameStatsSummary(const FrameStats &stats);
+
+// draws a bar per timer along the bottom of the window, its length the
+// timer's average (the full width being two 60 Hz frames) with a mark at
+// its 95th percentile; uses scissored clears, so no shader or geometry
+void DrawFrameStatsOverlay(const FrameStats &stats, int windowWidth);
+
+// prints the mean and 50th, 95th and 99th percentiles of every timer
+void PrintFrameStats(const FrameStats &stats);
+
+// deallocate the queries
+void DestroyFrameStats(FrameStats *stats);
@@ -0,0 +1,208 @@
+#include "imageloader.h"
+#include "pngstream.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+DecodedImage::DecodedImage() : uploadSlot(-1), waitMs(0), decodeMs(0), fromCache(false), scale(1)
+	{}
+
+ImageLoader::ImageLoader() : generation(0), stopping(false), uploader(nullptr), maxTextureSize(0),
+	pixelCache(nullptr), previewWidth(0), previewHeight(0)
+	{}
+
+static double ElapsedMs(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end)
+{
+	return chrono::duration<double, milli>(end - start).count();
+}
+
+// frees the pixels of an image nobody wants any more
+static void DiscardImage(ImageLoader *loader, DecodedImage *image)
+{
+	DestroyPixels(&image->pixels);
+	if (image->uploadSlot >= 0) ReleaseUploadSlot(loader->uploader, image->uploadSlot);
+	image->uploadSlot = -1;
+}
+
+// moves the pixels into a slot of the upload ring if one is free
+static void CopyToUploadSlot(ImageLoader *loader, DecodedImage *image)
+{
+	MyPixels &pixels = image->pixels;
+	if (!loader->uploader || !pixels.data) return;
+	if (loader->maxTextureSize > 0 && max(pixels.width, pixels.height) > loader->maxTextureSize) return;
+
+	size_t bytes = (size_t)pixels.width * pixels.height * pixels.components;
+	unsigned char *memory = nullptr;
+	image->uploadSlot = AcquireUploadSlot(loader->uploader, bytes, &memory);
+	if (image->uploadSlot < 0) return;
+
+	memcpy(memory, pixels.data, bytes);
+	MyPixels size = pixels;
+	DestroyPixels(&pixels);
+	pixels.width = size.width;
+	pixels.height = size.height;
+	pixels.components = size.components;
+}
+
+// decodes a PNG row by row straight into a slot of the upload ring, writing
+// the pixel cache entry on the way, so the image is never
+// whole in client memory; false if it cannot be streamed or does not fit
+static bool StreamToUploadSlot(ImageLoader *loader, const char *filename, DecodedImage *image)
+{
+	if (!loader->uploader || !IsPngPath(filename)) return false;
+
+	unsigned char *memory = nullptr;
+	size_t stride = 0;
+	PixelCacheEntry entry;
+	bool caching = false;
+	MyPixels &pixels = image->pixels;
+	bool streamed = StreamPngRows(filename, [&](int width, int height, int components) {
+		// images drawn from tiles need their pixels in client memory
+		if (loader->maxTextureSize > 0 && max(width, height) > loader->maxTextureSize) return false;
+		stride = (size_t)width * components;
+		image->uploadSlot = AcquireUploadSlot(loader->uploader, stride * height, &memory);
+		if (image->uploadSlot < 0) return false;
+
+		pixels.width = width;
+		pixels.height = height;
+		pixels.components = components;
+		caching = BeginPixelCacheEntry(loader->pixelCache, &entry, filename, width, height, components);
+		return true;
+	}, [&](int y, const unsigned char *row) {
+		memcpy(memory + y * stride, row, stride);
+		if (caching) WritePixelCacheRow(&entry, y, row);
+	});
+
+	if (caching) FinishPixelCacheEntry(&entry, streamed);
+	if (!streamed) {
+		if (image->uploadSlot >= 0) ReleaseUploadSlot(loader->uploader, image->uploadSlot);
+		image->uploadSlot = -1;
+		pixels = MyPixels();
+		return false;
+	}
+	return true;
+}
+
+void LoadImagePixels(ImageLoader *loader, const ImageRequest &request, DecodedImage *image)
+{
+	TraceSpan span("load image");
+	auto start = chrono::steady_clock::now();
+	image->path = request.path;
+	image->scale = 1;
+	const char *filename = request.path.c_str();
+
+	// mapping the full-size pixels beats any decode, even a reduced one
+	image->fromCache = MapCachedPixels(loader->pixelCache, &image->pixels, filename);
+	int scale = 1;
+	if (!image->fromCache && request.preview && loader->previewWidth > 0 && IsJpegPath(request.path)) {
+		scale = JpegPreviewScale(filename, loader->previewWidth, loader->previewHeight);
+	}
+	if (scale > 1) {
+		// stb_image may still read what libjpeg rejects
+		if (DecodeJpegScaled(&image->pixels, filename, scale)) {
+			image->scale = scale;
+		} else {
+			scale = 1;
+		}
+	}
+	if (scale == 1 && !image->fromCache && !StreamToUploadSlot(loader, filename, image)) {
+		LoadPixels(loader->pixelCache, &image->pixels, filename, &image->fromCache);
+	}
+	image->decodeMs = ElapsedMs(start, chrono::steady_clock::now());
+}
+
+static void LoaderThread(ImageLoader *loader)
+{
+	SetTraceThreadName("image loader");
+	unique_lock<mutex> lock(loader->mutex);
+	for (;;) {
+		loader->wake.wait(lock, [&]() { return loader->stopping || !loader->requests.empty(); });
+		if (loader->stopping) return;
+
+		DecodedImage image;
+		ImageRequest request = loader->requests.front();
+		loader->requests.pop_front();
+		unsigned generation = loader->generation;
+		auto start = chrono::steady_clock::now();
+		image.waitMs = ElapsedMs(loader->requested, start);
+
+		lock.unlock();
+		LoadImagePixels(loader, request, &image);
+		CopyToUploadSlot(loader, &image);
+		lock.lock();
+
+		// another image was asked for while this one decoded
+		if (generation != loader->generation) {
+			DiscardImage(loader, &image);
+			continue;
+		}
+		loader->decoded.push_back(image);
+		if (loader->notify) loader->notify();
+	}
+}
+
+bool InitializeImageLoader(ImageLoader *loader, int threadCount, const function<void()> &notify,
+						   PixelUploader *uploader)
+{
+	loader->notify = notify;
+	loader->uploader = uploader;
+	loader->stopping = false;
+	for (int i = 0; i < max(threadCount, 1); i++) {
+		loader->threads.push_back(thread(LoaderThread, loader));
+	}
+	return true;
+}
+
+// drops pending requests and finished but untaken images (mutex held)
+static void DropStale(ImageLoader *loader)
+{
+	loader->generation++;
+	loader->requests.clear();
+	for (DecodedImage &image : loader->decoded) DiscardImage(loader, &image);
+	loader->decoded.clear();
+}
+
+void RequestImage(ImageLoader *loader, const string &path, bool preview)
+{
+	lock_guard<mutex> lock(loader->mutex);
+	DropStale(loader);
+	loader->requested = chrono::steady_clock::now();
+	ImageRequest request;
+	request.path = path;
+	request.preview = preview;
+	loader->requests.push_back(request);
+	loader->wake.notify_one();
+}
+
+void CancelImageRequests(ImageLoader *loader)
+{
+	lock_guard<mutex> lock(loader->mutex);
+	DropStale(loader);
+}
+
+bool TakeDecodedImage(ImageLoader *loader, DecodedImage *image)
+{
+	lock_guard<mutex> lock(loader->mutex);
+	if (loader->decoded.empty()) return false;
+
+	*image = loader->decoded.front();
+	loader->decoded.pop_front();
+	return true;
+}
+
+void DestroyImageLoader(ImageLoader *loader)
+{
+	{
+		lock_guard<mutex> lock(loader->mutex);
+		loader->stopping = true;
+		loader->requests.clear();
+	}
+	loader->wake.notify_all();
+	for (thread &t : loader->threads) t.join();
+	loader->threads.clear();
+
+	for (DecodedImage &image : loader->decoded) DiscardImage(loader, &image);
+	loader->decoded.clear();
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "jpegdecode.h"
+#include "pixelcache.h"
+#include "pixelupload.h"
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// Image files decoded on background threads, so the window keeps drawing
+// the current image while the next one decodes. Only the most recent
+// request matters: requests made before it are dropped unstarted, or
+// discarded when they finish. With two or more threads a new request starts
+// at once even while a stale decode is still running.
+
+struct DecodedImage
+{
+	std::string path;
+	MyPixels pixels;		// data is null if they were copied to uploadSlot
+	int uploadSlot;			// or -1 when they are in pixels.data
+	double waitMs;			// from the request until a thread started on it
+	double decodeMs;		// spent decoding, or mapping the pixel cache entry
+	bool fromCache;			// mapped from the pixel cache
+	int scale;				// the pixels are 1 / scale of the image's size
+
+	// initialize to an image that could not be decoded
+	DecodedImage();
+};
+
+struct ImageRequest
+{
+	std::string path;
+	bool preview;			// a reduced JPEG decode will do
+};
+
+struct ImageLoader
+{
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+
+	// guarded by mutex
+	std::deque<ImageRequest> requests;
+	std::deque<DecodedImage> decoded;
+	unsigned generation;	// of the newest request, older ones are stale
+	std::chrono::steady_clock::time_point requested;
+	bool stopping;
+
+	// called on a loader thread whenever an image is ready, to wake the
+	// GL thread (e.g. glfwPostEmptyEvent)
+	std::function<void()> notify;
+
+	// when set, decoded pixels are copied into a free slot of its ring,
+	// unless the image is wider or taller than maxTextureSize (0 for no
+	// limit) and will be drawn from tiles out of client memory
+	PixelUploader *uploader;
+	int maxTextureSize;
+
+	// when set, images are looked up in the pixel cache before decoding
+	PixelCache *pixelCache;
+
+	// the window size previews are decoded for, 0 x 0 for no previews
+	int previewWidth;
+	int previewHeight;
+
+	// initialize to a loader with no threads
+	ImageLoader();
+};
+
+// the uploader may be null to keep decoded pixels in client memory
+bool InitializeImageLoader(ImageLoader *loader, int threadCount, const std::function<void()> &notify,
+						   PixelUploader *uploader = nullptr);
+
+// queues the file for decoding, making every earlier request stale. With
+// preview set a JPEG that is much larger than the window is decoded at a
+// reduced size (see jpegdecode.h), unless its full-size pixels are in the
+// pixel cache; request it again without preview to get the full size.
+void RequestImage(ImageLoader *loader, const std::string &path, bool preview = false);
+
+// what a loader thread does for a request, for decoding on the calling
+// thread instead: sets the pixels, fromCache, scale and decodeMs.
+// With an uploader a PNG may be decoded row by row straight into a slot
+// (see pngstream.h), setting uploadSlot too.
+void LoadImagePixels(ImageLoader *loader, const ImageRequest &request, DecodedImage *image);
+
+// makes every request so far stale, e.g. when a cached image is shown
+void CancelImageRequests(ImageLoader *loader);
+
+// hands over the newest request's pixels once they are decoded, returning
+// false if they are not ready; the caller must DestroyPixels() them, and
+// upload from and fence the slot if they are in one
+bool TakeDecodedImage(ImageLoader *loader, DecodedImage *image);
+
+// stops the threads, waiting for any decode in progress
+void DestroyImageLoader(ImageLoader *loader);
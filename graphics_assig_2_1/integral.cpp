@@ -0,0 +1,142 @@
+#include "integral.h"
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+// Vector adds of one table row onto the next
+
+static void AddRow(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+	for (; i + 4 <= count; i += 4) {
+		__m128i sum = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(dst + i)), _mm_loadu_si128((const __m128i *)(src + i)));
+		_mm_storeu_si128((__m128i *)(dst + i), sum);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	for (; i + 4 <= count; i += 4) {
+		vst1q_u32(dst + i, vaddq_u32(vld1q_u32(dst + i), vld1q_u32(src + i)));
+	}
+#endif
+	for (; i < count; i++) dst[i] += src[i];
+}
+
+static void AddRow(uint64_t *dst, const uint64_t *src, size_t count)
+{
+	size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+	for (; i + 2 <= count; i += 2) {
+		__m128i sum = _mm_add_epi64(_mm_loadu_si128((const __m128i *)(dst + i)), _mm_loadu_si128((const __m128i *)(src + i)));
+		_mm_storeu_si128((__m128i *)(dst + i), sum);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	for (; i + 2 <= count; i += 2) {
+		vst1q_u64(dst + i, vaddq_u64(vld1q_u64(dst + i), vld1q_u64(src + i)));
+	}
+#endif
+	for (; i < count; i++) dst[i] += src[i];
+}
+
+// --------------------------------------------------------------------------
+// Table construction
+
+template <typename T>
+static bool BuildTable(IntegralImage<T> *table, const MyPixels &pixels)
+{
+	int width = pixels.width;
+	int height = pixels.height;
+	int components = pixels.components;
+	if (pixels.data == nullptr || components < 1 || components > 4) {
+		cout << "Invalid image format for integral image" << endl;
+		return false;
+	}
+
+	table->width = width;
+	table->height = height;
+	table->components = components;
+	size_t stride = (size_t)(width + 1) * components;
+	table->sums.assign(stride * (height + 1), 0);
+
+	// prefix sums along every row; entry i + components continues entry i,
+	// which keeps the channels of interleaved pixels apart
+	ParallelRows(height, [&](int first, int end) {
+		for (int y = first; y < end; y++) {
+			const unsigned char *in = pixels.data + (size_t)y * width * components;
+			T *out = &table->sums[(size_t)(y + 1) * stride];
+			for (size_t i = 0; i < (size_t)width * components; i++) {
+				out[i + components] = out[i] + in[i];
+			}
+		}
+	});
+
+	// then down the columns: each band of entries adds the row above, so
+	// every thread streams through contiguous memory
+	ParallelRows((int)stride, [&](int first, int end) {
+		for (int y = 2; y <= height; y++) {
+			T *row = &table->sums[(size_t)y * stride + first];
+			AddRow(row, row - stride, end - first);
+		}
+	});
+	return true;
+}
+
+bool BuildIntegralImage(IntegralImage32 *table, const MyPixels &pixels)
+{
+	return BuildTable(table, pixels);
+}
+
+bool BuildIntegralImage(IntegralImage64 *table, const MyPixels &pixels)
+{
+	return BuildTable(table, pixels);
+}
+
+// --------------------------------------------------------------------------
+// Queries
+
+template <typename T>
+static bool BoxMean(const IntegralImage<T> &table, MyImage *dst, int radius)
+{
+	int size = 2 * radius + 1;
+	if (sizeof(T) < sizeof(uint64_t) && NeedsIntegral64(size, size)) {
+		cout << "Box of radius " << radius << " can overflow a 32-bit integral image" << endl;
+		return false;
+	}
+
+	InitializeImage(dst, table.width, table.height);
+	ParallelRows(table.height, [&](int first, int end) {
+		for (int y = first; y < end; y++) {
+			int y0 = max(y - radius, 0);
+			int y1 = min(y + radius + 1, table.height);
+			float *out = &dst->pixels[(size_t)y * table.width * 4];
+			for (int x = 0; x < table.width; x++, out += 4) {
+				int x0 = max(x - radius, 0);
+				int x1 = min(x + radius + 1, table.width);
+				float scale = 1.0f / (255.0f * (x1 - x0) * (y1 - y0));
+
+				out[1] = out[2] = 0.0f;
+				out[3] = 1.0f;
+				for (int c = 0; c < table.components; c++) {
+					out[c] = RectSum(table, x0, y0, x1, y1, c) * scale;
+				}
+			}
+		}
+	});
+	return true;
+}
+
+bool IntegralBoxMean(const IntegralImage32 &table, MyImage *dst, int radius)
+{
+	return BoxMean(table, dst, radius);
+}
+
+bool IntegralBoxMean(const IntegralImage64 &table, MyImage *dst, int radius)
+{
+	return BoxMean(table, dst, radius);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "filters.h"
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// Summed-area tables (integral images) of decoded 8-bit pixels
+//
+// Entry (x, y) holds, per channel, the sum of every pixel above and to the
+// left of (x, y), exclusive, so the table is (width + 1) x (height + 1) and
+// the sum over any rectangle takes four lookups.
+//
+// Sums are unsigned and wrap on overflow, which keeps rectangle sums exact as
+// long as the true sum of that rectangle fits: with 32-bit entries that is
+// any rectangle of up to MAX_AREA_32 pixels (about 4104 x 4104), whatever
+// the size of the image. Use 64-bit entries when a single query can cover
+// more; they are exact for any image up to 16k x 16k and far beyond.
+// Offsets are computed in size_t, so the table itself may exceed 2^32
+// entries (a 16k x 16k RGBA 64-bit table is 8.6 GB).
+
+const uint64_t MAX_AREA_32 = 0xFFFFFFFFull / 255;
+
+template <typename T>
+struct IntegralImage
+{
+	int width;		// of the image, the table has one more row and column
+	int height;
+	int components;
+	std::vector<T> sums;
+
+	// initialize to an empty table
+	IntegralImage() : width(0), height(0), components(0) {}
+};
+
+typedef IntegralImage<uint32_t> IntegralImage32;
+typedef IntegralImage<uint64_t> IntegralImage64;
+
+// true when a rectangle of the given size can overflow a 32-bit table
+inline bool NeedsIntegral64(int width, int height)
+{
+	return (uint64_t)width * (uint64_t)height > MAX_AREA_32;
+}
+
+// builds the table with rows prefixed in parallel, then columns accumulated
+// in parallel bands with SIMD adds across each row
+bool BuildIntegralImage(IntegralImage32 *table, const MyPixels &pixels);
+bool BuildIntegralImage(IntegralImage64 *table, const MyPixels &pixels);
+
+// sum of channel c over x0 <= x < x1, y0 <= y < y1, clamped to the image
+template <typename T>
+inline T RectSum(const IntegralImage<T> &table, int x0, int y0, int x1, int y1, int c)
+{
+	x0 = std::min(std::max(x0, 0), table.width);
+	x1 = std::min(std::max(x1, 0), table.width);
+	y0 = std::min(std::max(y0, 0), table.height);
+	y1 = std::min(std::max(y1, 0), table.height);
+
+	size_t stride = (size_t)(table.width + 1) * table.components;
+	const T *top = &table.sums[(size_t)y0 * stride + c];
+	const T *bottom = &table.sums[(size_t)y1 * stride + c];
+	return bottom[(size_t)x1 * table.components] - bottom[(size_t)x0 * table.components]
+		 - top[(size_t)x1 * table.components] + top[(size_t)x0 * table.components];
+}
+
+// mean of the (2 * radius + 1) square around each pixel in constant time per
+// pixel; near the border only the pixels inside the image are averaged.
+// Fails for a 32-bit table when the square can overflow it.
+bool IntegralBoxMean(const IntegralImage32 &table, MyImage *dst, int radius);
+bool IntegralBoxMean(const IntegralImage64 &table, MyImage *dst, int radius);
@@ -0,0 +1,128 @@
+#include "jpegdecode.h"
+#include "trace.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#ifdef HAVE_LIBJPEG
+#include <csetjmp>
+#include <jpeglib.h>
+#endif
+
+using namespace std;
+
+bool IsJpegPath(const string &path)
+{
+	size_t dot = path.rfind('.');
+	if (dot == string::npos) return false;
+	string extension = path.substr(dot + 1);
+	transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == "jpg" || extension == "jpeg";
+}
+
+#ifdef HAVE_LIBJPEG
+
+// libjpeg reports errors by calling error_exit, which must not return
+struct JpegError
+{
+	jpeg_error_mgr manager;
+	jmp_buf jump;
+};
+
+static void JpegErrorExit(j_common_ptr info)
+{
+	JpegError *error = (JpegError *)info->err;
+	char message[JMSG_LENGTH_MAX];
+	info->err->format_message(info, message);
+	cout << "JPEG decode: " << message << endl;
+	longjmp(error->jump, 1);
+}
+
+// decodes the image at 1 / scale of its size
+static bool ReadJpeg(const char *filename, int scale, MyPixels *pixels)
+{
+	FILE *file = fopen(filename, "rb");
+	if (!file) return false;
+
+	jpeg_decompress_struct info;
+	JpegError error;
+	info.err = jpeg_std_error(&error.manager);
+	error.manager.error_exit = JpegErrorExit;
+	unsigned char *volatile data = nullptr;
+	if (setjmp(error.jump)) {
+		jpeg_destroy_decompress(&info);
+		fclose(file);
+		free(data);
+		*pixels = MyPixels();
+		return false;
+	}
+
+	jpeg_create_decompress(&info);
+	jpeg_stdio_src(&info, file);
+	jpeg_read_header(&info, TRUE);
+
+	// grey stays one component, everything else comes out as RGB
+	info.out_color_space = info.num_components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+	info.scale_num = 1;
+	info.scale_denom = scale;
+	info.dct_method = JDCT_ISLOW;
+	jpeg_start_decompress(&info);
+
+	int components = info.output_components;
+	size_t stride = (size_t)info.output_width * components;
+	data = (unsigned char *)malloc(stride * info.output_height);
+	while (info.output_scanline < info.output_height) {
+		// rows arrive top first; store them bottom first
+		JSAMPROW row = data + (info.output_height - 1 - info.output_scanline) * stride;
+		jpeg_read_scanlines(&info, &row, 1);
+	}
+
+	// handed over only once nothing can fail any more
+	jpeg_finish_decompress(&info);
+	pixels->data = data;
+	pixels->width = info.output_width;
+	pixels->height = info.output_height;
+	pixels->components = components;
+	jpeg_destroy_decompress(&info);
+	fclose(file);
+	return true;
+}
+
+#endif
+
+int JpegPreviewScale(const char *filename, int width, int height)
+{
+#ifndef HAVE_LIBJPEG
+	// decoding in full to average it down costs more than the full image
+	// alone, which is decoded once the preview is zoomed past anyway
+	return 1;
+#else
+	int imageWidth = 0, imageHeight = 0;
+	if (!ReadImageSize(filename, &imageWidth, &imageHeight)) return 1;
+
+	// the fitted image is as many times smaller than the full one as its
+	// more constrained side requires
+	float reduction = max((float)imageWidth / max(width, 1), (float)imageHeight / max(height, 1));
+	int scale = 1;
+	while (scale < MAX_JPEG_SCALE && scale * 2 <= reduction) scale *= 2;
+	return scale;
+#endif
+}
+
+bool DecodeJpegScaled(MyPixels *pixels, const char *filename, int scale)
+{
+	if (scale <= 1) return DecodePixels(pixels, filename);
+	TraceSpan span("decode jpeg scaled");
+
+#ifdef HAVE_LIBJPEG
+	return ReadJpeg(filename, scale, pixels);
+#else
+	// rounded up like the DCT scaling does
+	MyPixels full;
+	if (!DecodePixels(&full, filename)) return false;
+	ReducePixels(full, scale, pixels);
+	DestroyPixels(&full);
+	return true;
+#endif
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// JPEG previews decoded at 1/2, 1/4 or 1/8 of their size. With libjpeg
+// (HAVE_LIBJPEG, which CMakeLists.txt defines when it finds libjpeg or
+// libjpeg-turbo) the scaling happens in the inverse DCT, so a 1/8 preview
+// does a fraction of the work of a full decode. Without it there are no
+// previews, as stb_image would have to decode the image in full first.
+
+// the largest reduction that is ever used
+const int MAX_JPEG_SCALE = 8;
+
+// true if the path names a JPEG file
+bool IsJpegPath(const std::string &path);
+
+// the largest of 1, 2, 4 and 8 that the image can be reduced by and still
+// have a texel for every pixel when fitted into width x height pixels;
+// 1 if the file's header cannot be read or there is no libjpeg
+int JpegPreviewScale(const char *filename, int width, int height);
+
+// decodes the image at 1 / scale of its size (rounded up), bottom row first
+// like DecodePixels(), into memory DestroyPixels() releases; fails on JPEGs
+// libjpeg cannot convert to RGB (CMYK) or finds corrupt, leaving pixels
+// empty
+bool DecodeJpegScaled(MyPixels *pixels, const char *filename, int scale);
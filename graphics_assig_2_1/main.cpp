@@ -18,9 +18,11 @@
 #include <sstream>
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <string>
 #include <vector>
 #include <iterator>
+#include <cstdlib>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -29,6 +31,23 @@
 #include <GLFW/glfw3.h>
 
 #include "texture.h"
+#include "shader.h"
+#include "filters.h"
+#include "blur.h"
+#include "filterpass.h"
+#include "cpublur.h"
+#include "texturecache.h"
+#include "imageloader.h"
+#include "pixelcache.h"
+#include "pixelupload.h"
+#include "thumbnail.h"
+#include "tiledtexture.h"
+#include "tilepyramid.h"
+#include "benchmark.h"
+#include "batch.h"
+#include "offscreen.h"
+#include "framestats.h"
+#include "trace.h"
 
 using namespace std;
 using namespace glm;
@@ -38,18 +57,63 @@ using namespace glm;
 void QueryGLVersion();
 bool CheckGLErrors();
 
-string LoadSource(const string &filename);
-GLuint CompileShader(GLenum shaderType, const string &source);
-GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader);
 void addVertices(MyTexture incomingTexture);
-void resetLuminance();
+void loadImage(const string &path);
+void showImage(const string &path, const MyTexture &texture, int scale = 1);
+void showDecodedImage(const string &path, MyPixels *pixels, int scale = 1);
+void showPreview(const string &path, const MyPixels &pixels, const char *source);
+void showTilePyramid(const string &path);
+void showTiledImage(const string &path);
+void closeTiledImage();
+void closePreview();
+void startLoadTiming(const string &path);
+void markImageShown(const string &path, const string &source, bool sharp);
+void logLoadTiming();
 
+// the image on screen; the GL texture is owned by textureCache, is the
+// preview texture, or the image is tiled and myTexture only gives its size
 MyTexture myTexture;
+TiledTexture tiledTexture;
+MyTexture previewTexture;		// a thumbnail shown until the image decodes
+int imageWidth = 1;				// of the full image, which myTexture may be
+int imageHeight = 1;			// a reduced version of
+bool fullSizeRequested = false;	// for the preview on screen
+TextureCache textureCache;
+ThumbnailCache thumbnails;
+ImageLoader imageLoader;
+PixelCache pixelCache;
+PixelUploader pixelUploader;
 vector<vec2> vertices;
 vector<vec3> colours;
 vector<vec2> textureCoords;
 
 string image_path = "res/image5-pattern.png";
+
+// the images keys 1 to 6 show
+const char *imagePaths[] = {
+    "res/image1-mandrill.png",
+    "res/image2-uclogo.png",
+    "res/image3-aerial.jpg",
+    "res/image4-thirsk.jpg",
+    "res/image5-pattern.png",
+    "res/image6-Banff.jpg"
+};
+
+// times an image switch from the key press until its first pixels, and then
+// its full-size pixels, are on screen
+struct LoadTiming
+{
+    string path;                // empty when nothing is being timed
+    chrono::steady_clock::time_point start;
+    string firstSource;         // what was shown first, e.g. "EXIF thumbnail"
+    bool firstPending;          // shown, logged after the next swap
+    bool firstLogged;
+    string sharpSource;
+    bool sharpPending;
+    
+    LoadTiming() : firstPending(false), firstLogged(false), sharpPending(false) {}
+};
+LoadTiming loadTiming;
 bool leftClicked = false;
 bool rightClicked = false;
 bool isScroll = false;
@@ -63,34 +127,60 @@ float initImageHeight;
 
 float kernelSize = 9.0f;
 mat4 transformVertice = mat4(1.0f);
-float adjustBrightness = 0;
-float doSobel = 0;
-float horSobel = 0;
-float doUnSharp = 0;
-float doGauss = 0;
-float gaussVal = 0;
-
-struct LuminanceValues
-{
-    float r;
-    float g;
-    float b;
-};
-LuminanceValues luminanceValues;
+const float MAX_CPU_BLUR_SIGMA = 200.0f;
+
+// images wider or taller than this are drawn from tiles
+int maxTextureSize = 0;
+
+// tiles uploaded per frame, so streaming them in never stalls the window
+const int MAX_TILE_UPLOADS_PER_FRAME = 16;
+
+// the effect chosen with the keyboard, and whether the filtered image is stale
+FilterParams filterParams;
+bool filterParamsChanged = true;
+
+// the window is only redrawn, and the vertices only uploaded, after the
+// callbacks mark them as changed; otherwise the main loop sleeps
+bool geometryChanged = true;
+bool sceneChanged = true;
+
+// GPU and CPU time of each pass, drawn over the image while showFrameStats
+// is set (key T); the window then redraws continuously to keep it current
+const char *WINDOW_TITLE = "CPSC 453 OpenGL Boilerplate";
+FrameStats frameStats;
+bool showFrameStats = false;
+
+// spans of the loading, uploading and drawing, written to tracePath on exit
+// and when P is pressed, if tracing was turned on with --trace
+string tracePath;
 
 
 // --------------------------------------------------------------------------
 // Functions to set up OpenGL shader programs for rendering
 
+// the program that draws the image, with the location of its per-frame
+// uniform looked up once after linking
+struct DisplayProgram
+{
+    GLuint program;
+    GLint transformLocation;
+    GLint tileLevelLocation;
+    
+    DisplayProgram() : program(0), transformLocation(-1), tileLevelLocation(-1) {}
+};
+
 // load, compile, and link shaders, returning true if successful
-GLuint InitializeShaders()
+bool InitializeShaders(DisplayProgram *display)
 {
+    TraceSpan span("InitializeShaders");
+    
     // load shader source from files
     string vertexSource = LoadSource("shaders/vertex.glsl");
     string fragmentSource = LoadSource("shaders/fragment.glsl");
     if (vertexSource.empty() || fragmentSource.empty()) return false;
     
-    // compile shader source into shader objects
+    // compile shader source into shader objects (fragment.glsl without an
+    // effect defined just displays the texture, see filterpass.h)
     GLuint vertex = CompileShader(GL_VERTEX_SHADER, vertexSource);
     GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
     
@@ -100,8 +190,49 @@ GLuint InitializeShaders()
     glDeleteShader(vertex);
     glDeleteShader(fragment);
     
+    display->program = program;
+    display->transformLocation = glGetUniformLocation(program, "transform");
+    
     // check for OpenGL errors and return false if error occurred
-    return program;
+    return !CheckGLErrors();
+}
+
+// the programs that draw a tiled image, one per effect: the effects cannot
+// run at image resolution beforehand, so they run as the tiles are drawn
+bool InitializeTiledShaders(DisplayProgram programs[VARIANT_COUNT])
+{
+    string vertexSource = LoadSource("shaders/vertex.glsl");
+    string fragmentSource = LoadSource("shaders/fragment.glsl");
+    if (vertexSource.empty() || fragmentSource.empty()) return false;
+    
+    ostringstream tileDefines;
+    tileDefines << "#define TILED_TEXTURE\n"
+                << "#define TILE_SIZE " << TILE_SIZE << ".0\n"
+                << "#define TILE_GUTTER " << TILE_GUTTER << ".0\n"
+                << "#define TILE_CONTENT " << TILE_CONTENT << ".0\n";
+    
+    GLuint vertex = CompileShader(GL_VERTEX_SHADER, vertexSource);
+    for (int i = 0; i < VARIANT_COUNT; i++) {
+        string defines = tileDefines.str() + VariantDefines((ShaderVariant)i);
+        GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, DefineSource(fragmentSource, defines));
+        GLuint program = LinkProgram(vertex, fragment);
+        glDeleteShader(fragment);
+        
+        // the effect settings come from the filter pass's uniform buffer,
+        // the atlas from unit 0 and the page table from unit 1
+        glUniformBlockBinding(program, glGetUniformBlockIndex(program, "FilterUniforms"), FILTER_UNIFORMS_BINDING);
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "textureImage_one"), 0);
+        glUniform1i(glGetUniformLocation(program, "pageTable"), 1);
+        glUseProgram(0);
+        
+        programs[i].program = program;
+        programs[i].transformLocation = glGetUniformLocation(program, "transform");
+        programs[i].tileLevelLocation = glGetUniformLocation(program, "tileLevel");
+    }
+    glDeleteShader(vertex);
+    
+    return !CheckGLErrors();
 }
 
 // --------------------------------------------------------------------------
@@ -117,7 +248,7 @@ struct Geometry
     GLsizei elementCount;
     
     // initialize object names to zero (OpenGL reserved value)
-    Geometry() : vertexBuffer(0), colourBuffer(0), vertexArray(0), elementCount(0)
+    Geometry() : vertexBuffer(0), textureBuffer(0), colourBuffer(0), vertexArray(0), elementCount(0)
     {}
 };
 
@@ -214,67 +345,77 @@ void DestroyGeometry(Geometry *geometry)
     glDeleteVertexArrays(1, &geometry->vertexArray);
     glDeleteBuffers(1, &geometry->vertexBuffer);
     glDeleteBuffers(1, &geometry->colourBuffer);
+    glDeleteBuffers(1, &geometry->textureBuffer);
 }
 
 // --------------------------------------------------------------------------
 // Rendering function that draws our scene to the frame buffer
 
-void RenderScene(Geometry *geometry, MyTexture *texture, GLuint program)
+// applies the mouse movement since the last frame to the transform
+void UpdateTransform()
 {
-    // clear screen to a dark grey colour
-    glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-    
-    // transformations
     if (leftClicked) {
         // translate the image
-        transformVertice = translate(transformVertice, vec3(( translateSpeed*((float)xpos - (float)prevx)/(float)myTexture.width), -translateSpeed*(((float)ypos - (float)prevy)/(float)myTexture.height) , 0.0f));
+        transformVertice = translate(transformVertice, vec3(( translateSpeed*((float)xpos - (float)prevx)/(float)imageWidth), -translateSpeed*(((float)ypos - (float)prevy)/(float)imageHeight) , 0.0f));
     } else if (rightClicked) {
         // rotate the image
-        transformVertice = rotate(transformVertice, (((float)xpos - (float)prevx) /(float)myTexture.width), vec3(0.0f, 0.0f, 1.0f));
+        transformVertice = rotate(transformVertice, (((float)xpos - (float)prevx) /(float)imageWidth), vec3(0.0f, 0.0f, 1.0f));
     }
     prevx = xpos;
     prevy = ypos;
+}
+
+// the part of the image inside the window, as a range of texture
+// coordinates (u0, v0, u1, v1), and how many texels of myTexture one window
+// pixel covers
+void VisibleRegion(GLFWwindow *window, float region[4], float *texelsPerPixel)
+{
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    
+    // the window corners taken back through the transform onto the image
+    mat4 toImage = inverse(transformVertice);
+    region[0] = region[1] = 1.0f;
+    region[2] = region[3] = 0.0f;
+    for (float x : { -1.0f, 1.0f }) {
+        for (float y : { -1.0f, 1.0f }) {
+            vec4 corner = toImage * vec4(x, y, 0.0f, 1.0f);
+            float u = (corner.x / initImageWidth + 1.0f) * 0.5f;
+            float v = (corner.y / initImageHeight + 1.0f) * 0.5f;
+            region[0] = std::min(region[0], u);
+            region[1] = std::min(region[1], v);
+            region[2] = std::max(region[2], u);
+            region[3] = std::max(region[3], v);
+        }
+    }
+    
+    // the width of the image on screen, in pixels
+    vec4 across = transformVertice * vec4(2.0f * initImageWidth, 0.0f, 0.0f, 0.0f);
+    float pixels = 0.5f * sqrt(across.x * width * across.x * width + across.y * height * across.y * height);
+    *texelsPerPixel = (float)myTexture.width / std::max(pixels, 1.0f);
+}
+
+// draws the image, or the tiles of a tiled one with the page table bound
+void RenderScene(Geometry *geometry, const MyTexture *texture, const DisplayProgram &program,
+                 const TiledTexture *tiled = nullptr)
+{
+    TraceSpan span("RenderScene");
+    
+    // clear screen to a dark grey colour
+    glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
     
     // bind our shader program and the vertex array object containing our
     // scene geometry, then tell OpenGL to draw our geometry
-    glUseProgram(program);
+    glUseProgram(program.program);
     
     // transformation
-    unsigned int transformLoc = glGetUniformLocation(program, "transform");
-    glUniformMatrix4fv(transformLoc, 1, GL_FALSE, value_ptr(transformVertice));
-    
-    // luminance
-    unsigned int luminanceOfTexture = glGetUniformLocation(program, "luminanceValues");
-    glUniform3f(luminanceOfTexture, luminanceValues.r, luminanceValues.g, luminanceValues.b);
-    
-    // brightness
-    unsigned int brightnessOfTexture = glGetUniformLocation(program, "adjustBrightness");
-    glUniform1f(brightnessOfTexture, adjustBrightness);
-    
-    // sobel
-    unsigned int sobelTexture = glGetUniformLocation(program, "doSobel");
-    glUniform1f(sobelTexture, doSobel);
-    
-    // sobal orientation
-    unsigned int sobelOrientation = glGetUniformLocation(program, "horSobel");
-    glUniform1f(sobelOrientation, horSobel);
-    
-    // image height and width
-    unsigned int textureWidth = glGetUniformLocation(program, "imageWidth");
-    glUniform1f(textureWidth, myTexture.width);
-    unsigned int textureHeight = glGetUniformLocation(program, "imageHeight");
-    glUniform1f(textureHeight, myTexture.height);
-    
-    // sharpen
-    unsigned int sharpen = glGetUniformLocation(program, "doUnSharp");
-    glUniform1f(sharpen, doUnSharp);
+    glUniformMatrix4fv(program.transformLocation, 1, GL_FALSE, value_ptr(transformVertice));
     
-    // gaus
-    unsigned int gauss = glGetUniformLocation(program, "doGauss");
-    glUniform1f(gauss, doGauss);
-    unsigned int gaussValue = glGetUniformLocation(program, "gaussVal");
-    glUniform1f(gaussValue, gaussVal);
+    if (tiled) {
+        glUniform1f(program.tileLevelLocation, (float)tiled->displayLevel);
+        BindPageTable(*tiled, 1);
+    }
     
     glBindVertexArray(geometry->vertexArray);
     glBindTexture(texture->target, texture->textureID);
@@ -282,6 +423,11 @@ void RenderScene(Geometry *geometry, MyTexture *texture, GLuint program)
     
     // reset state to default (no shader or geometry bound)
     glBindTexture(texture->target, 0);
+    if (tiled) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
     glBindVertexArray(0);
     glUseProgram(0);
     
@@ -300,9 +446,16 @@ void ErrorCallback(int error, const char* description)
 }
 
 // handles mouse input events
-static void cursorPositionCallback(GLFWwindow *window, double xpos, double ypos)
+static void cursorPositionCallback(GLFWwindow *window, double x, double y)
 {
-    //std::cout << xpos << " : " << ypos << std::endl;
+    //std::cout << x << " : " << y << std::endl;
+    xpos = x;
+    ypos = y;
+    
+    // dragging moves or rotates the image
+    if (leftClicked || rightClicked) {
+        sceneChanged = true;
+    }
 }
 void cursorEnterCallback(GLFWwindow *window, int entered)
 {
@@ -317,6 +470,8 @@ void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods)
     if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) {
         //std::cout << "Right button pressed" << std::endl;
         rightClicked = true;
+        prevx = xpos;
+        prevy = ypos;
     } else if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_RELEASE) {
         //std::cout << "Right button released" << std::endl;
         rightClicked = false;
@@ -357,6 +512,13 @@ void scrollCallback(GLFWwindow *window, double xoffset, double yoffset)
     }
     
     isScroll = false;
+    sceneChanged = true;
+}
+
+// the window needs redrawing after being uncovered or resized
+void windowRefreshCallback(GLFWwindow *window)
+{
+    sceneChanged = true;
 }
 
 // handles keyboard input events
@@ -366,181 +528,139 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
         glfwSetWindowShouldClose(window, GL_TRUE);
         
     // for changing image
-    } else if (key == GLFW_KEY_1 && action == GLFW_PRESS) {
-        image_path = "res/image1-mandrill.png";
-        if (!InitializeTexture(&myTexture, image_path.c_str())) {
-            cout << "Program failed to initialize texture!" << endl;
-        }
-        addVertices(myTexture);
-    } else if (key == GLFW_KEY_2 && action == GLFW_PRESS) {
-        image_path = "res/image2-uclogo.png";
-        if (!InitializeTexture(&myTexture, image_path.c_str())) {
-            cout << "Program failed to initialize texture!" << endl;
-        }
-        addVertices(myTexture);
-    } else if (key == GLFW_KEY_3 && action == GLFW_PRESS) {
-        image_path = "res/image3-aerial.jpg";
-        if (!InitializeTexture(&myTexture, image_path.c_str())) {
-            cout << "Program failed to initialize texture!" << endl;
-        }
-        addVertices(myTexture);
-    } else if (key == GLFW_KEY_4 && action == GLFW_PRESS) {
-        image_path = "res/image4-thirsk.jpg";
-        if (!InitializeTexture(&myTexture, image_path.c_str())) {
-            cout << "Program failed to initialize texture!" << endl;
-        }
-        addVertices(myTexture);
-    } else if (key == GLFW_KEY_5 && action == GLFW_PRESS) {
-        image_path = "res/image5-pattern.png";
-        if (!InitializeTexture(&myTexture, image_path.c_str())) {
-            cout << "Program failed to initialize texture!" << endl;
-        }
-        addVertices(myTexture);
-    } else if (key == GLFW_KEY_6 && action == GLFW_PRESS) {
-        image_path = "res/image6-Banff.jpg";
-        if (!InitializeTexture(&myTexture, image_path.c_str())) {
-            cout << "Program failed to initialize texture!" << endl;
-        }
-        addVertices(myTexture);
+    } else if (key >= GLFW_KEY_1 && key <= GLFW_KEY_6 && action == GLFW_PRESS) {
+        loadImage(imagePaths[key - GLFW_KEY_1]);
     }
     
-    // for luminance
-    else if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
-        doSobel = 0;
-        horSobel = 0;
-        adjustBrightness = 0;
-        doUnSharp = 0;
-        doGauss = 0.0f;
-        gaussVal = 0;
-        
-        luminanceValues.r = 0.333;
-        luminanceValues.g = 0.333;
-        luminanceValues.b = 0.333;
-    } else if (key == GLFW_KEY_X && action == GLFW_PRESS) {
-        doSobel = 0;
-        horSobel = 0;
-        adjustBrightness = 0;
-        doUnSharp = 0;
-        doGauss = 0.0f;
-        gaussVal = 0;
-        
-        luminanceValues.r = 0.299;
-        luminanceValues.g = 0.587;
-        luminanceValues.b = 0.114;
-    } else if (key == GLFW_KEY_C && action == GLFW_PRESS) {
-        doSobel = 0;
-        horSobel = 0;
-        adjustBrightness = 0;
-        doUnSharp = 0;
-        doGauss = 0.0f;
-        gaussVal = 0;
-        
-        luminanceValues.r = 0.213;
-        luminanceValues.g = 0.715;
-        luminanceValues.b = 0.072;
-    
-    // for brightness filter
-    } else if (key == GLFW_KEY_V && action == GLFW_PRESS) {
-        doSobel = 0;
-        horSobel = 0;
-        adjustBrightness = 1.0f;
-        doUnSharp = 0.0f;
-        doGauss = 0.0f;
-        gaussVal = 0;
-        
-        resetLuminance();
-        
-    // reset back to original
-    } else if (key == GLFW_KEY_B && action == GLFW_PRESS) {
-        doSobel = 0;
-        horSobel = 0;
-        adjustBrightness = 0;
-        doUnSharp = 0.0f;
-        doGauss = 0.0f;
-        gaussVal = 0;
-        
-        resetLuminance();
-    
-    // horizontal sobel filter
-    } else if (key == GLFW_KEY_S && action == GLFW_PRESS) {
-        doSobel = 1.0;
-        horSobel = 1.0;
-        adjustBrightness = 0;
-        doUnSharp = 0.0f;
-        doGauss = 0.0f;
-        gaussVal = 0;
-        
-        resetLuminance();
-    
-    // vertical sobel filter
-    } else if (key == GLFW_KEY_A && action == GLFW_PRESS) {
-        doSobel = 1.0f;
-        horSobel = 0.0;
-        adjustBrightness = 0;
-        doUnSharp = 0.0f;
-        doGauss = 0.0f;
-        gaussVal = 0;
-        
-        resetLuminance();
-    
-    // sharpen filter
-    } else if (key == GLFW_KEY_D && action == GLFW_PRESS) {
-        doSobel = 0;
-        horSobel = 0;
-        adjustBrightness = 0;
-        doUnSharp = 1.0f;
-        doGauss = 0.0f;
-        gaussVal = 0;
-        
-        resetLuminance();
-    
-    // gauss 3x3
-    } else if (key == GLFW_KEY_L && action == GLFW_PRESS) {
-        doSobel = 0;
-        horSobel = 0;
-        adjustBrightness = 0;
-        doUnSharp = 0.0f;
-        doGauss = 1.0f;
-        gaussVal = 3.0f;
-        
-        resetLuminance();
-    
-    // gauss 5x5
-    } else if (key == GLFW_KEY_K && action == GLFW_PRESS) {
-        doSobel = 0;
-        horSobel = 0;
-        adjustBrightness = 0;
-        doUnSharp = 0.0f;
-        doGauss = 1.0f;
-        gaussVal = 5.0f;
-        
-        resetLuminance();
-    
-    // gauss 7x7
-    } else if (key == GLFW_KEY_J && action == GLFW_PRESS) {
-        doSobel = 0;
-        horSobel = 0;
-        adjustBrightness = 0;
-        doUnSharp = 0.0f;
-        doGauss = 1.0f;
-        gaussVal = 7.0f;
-        
-        resetLuminance();
+    // effects, the keys are listed in FilterPreset()
+    else if (key >= GLFW_KEY_A && key <= GLFW_KEY_Z && action == GLFW_PRESS &&
+             FilterPreset((char)key, &filterParams)) {
+        filterParamsChanged = true;
+    
+    // narrower / wider gauss
+    } else if ((key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET) && action == GLFW_PRESS) {
+        FilterParams &params = filterParams;
+        if (params.doGauss > 0 || params.doBoxBlur > 0 || params.doRecursiveGauss > 0) {
+            // the CPU blurs have no tap limit, so they may go far wider
+            float factor = key == GLFW_KEY_RIGHT_BRACKET ? 1.25f : 0.8f;
+            float maxSigma = params.doGauss > 0 ? MAX_BLUR_SIGMA : MAX_CPU_BLUR_SIGMA;
+            params.gaussSigma = std::min(std::max(GaussSigma(params) * factor, 0.3f), maxSigma);
+            filterParamsChanged = true;
+        }
+    
+    // frame timing overlay
+    } else if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        showFrameStats = !showFrameStats;
+        if (!showFrameStats) glfwSetWindowTitle(window, WINDOW_TITLE);
+        sceneChanged = true;
+    
+    // write the trace so far
+    } else if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        if (TracingEnabled()) {
+            WriteTrace(tracePath.c_str());
+        } else {
+            cout << "Run with --trace <file> to record a trace" << endl;
+        }
     }
 }
 
-void resetLuminance()
-{
-    luminanceValues.r = 1.0;
-    luminanceValues.g = 1.0;
-    luminanceValues.b = 1.0;
-}
-
 // ==========================================================================
 // PROGRAM ENTRY POINT
 
 int main(int argc, char *argv[])
 {
+    // time the CPU filter engine without opening a window
+    if (argc > 1 && string(argv[1]) == "--cpu-bench") {
+        return RunFilterBenchmark(argc > 2 ? argv[2] : image_path.c_str());
+    }
+    
+    // time every effect on every image, on the CPU and through OpenGL
+    if (argc > 1 && string(argv[1]) == "--bench-suite") {
+        SuiteOptions options;
+        for (int i = 2; i < argc; i++) {
+            string option = argv[i];
+            if (option == "--frames" && i + 1 < argc) {
+                options.frames = atoi(argv[++i]);
+            } else if (option == "--warmup" && i + 1 < argc) {
+                options.warmup = atoi(argv[++i]);
+            } else if (option == "--json" && i + 1 < argc) {
+                options.jsonPath = argv[++i];
+            } else if (option == "--baseline" && i + 1 < argc) {
+                options.baselinePath = argv[++i];
+            } else if (option == "--tolerance" && i + 1 < argc) {
+                // allowed slowdown in percent
+                options.tolerance = atof(argv[++i]) / 100;
+            } else if (option == "--cpu-only") {
+                options.gl = false;
+            } else if (option == "--gl-only") {
+                options.cpu = false;
+            } else {
+                options.images.push_back(option);
+            }
+        }
+        if (options.images.empty()) options.images.assign(begin(imagePaths), end(imagePaths));
+        return RunEffectSuite(options);
+    }
+    
+    // filter a whole directory of images without opening a window
+    if (argc > 4 && string(argv[1]) == "--batch") {
+        // optionally followed by the decoder, filter and encoder thread counts
+        BatchStages stages;
+        if (argc > 5) stages.decoders = atoi(argv[5]);
+        if (argc > 6) stages.filterers = atoi(argv[6]);
+        if (argc > 7) stages.encoders = atoi(argv[7]);
+        return RunBatch(argv[2], argv[3][0], argv[4], stages);
+    }
+    
+    // apply a shader effect to one image in an offscreen context, without a
+    // window or display
+    if (argc > 4 && string(argv[1]) == "--render") {
+        return RenderEffectOffscreen(argv[2], argv[3][0], argv[4]);
+    }
+    
+    // write an image out as a tile pyramid file to open later
+    if (argc > 3 && string(argv[1]) == "--make-pyramid") {
+        TileCodec codec = TILE_CODEC_PNG;
+        if (argc > 4 && !ParseTileCodec(argv[4], &codec)) {
+            cout << "Tile codec must be raw, png or jpeg" << endl;
+            return 1;
+        }
+        return WriteTilePyramid(argv[2], argv[3], codec) ? 0 : 1;
+    }
+    
+    string pixelCacheDirectory = DEFAULT_PIXEL_CACHE_DIRECTORY;
+    size_t pixelCacheBytes = DEFAULT_PIXEL_CACHE_BYTES;
+    for (int i = 1; i < argc; i++) {
+        string option = argv[i];
+        if (option == "--texture-cache-mb" && i + 1 < argc) {
+            // GPU memory the textures of viewed images may keep, in megabytes
+            InitializeTextureCache(&textureCache, (size_t)atoi(argv[++i]) * 1024 * 1024);
+        } else if (option == "--max-texture-size" && i + 1 < argc) {
+            // tile images above this size even if the driver allows more
+            maxTextureSize = atoi(argv[++i]);
+        } else if (option == "--pixel-cache" && i + 1 < argc) {
+            // where decoded pixels are kept between runs
+            pixelCacheDirectory = argv[++i];
+        } else if (option == "--pixel-cache-mb" && i + 1 < argc) {
+            // disk space the cached pixels may take, in megabytes
+            pixelCacheBytes = (size_t)atoi(argv[++i]) * 1024 * 1024;
+        } else if (option == "--no-pixel-cache") {
+            pixelCacheDirectory.clear();
+        } else if (option == "--trace" && i + 1 < argc) {
+            // record spans and write them as Chrome trace JSON
+            tracePath = argv[++i];
+            EnableTracing(true);
+        } else if (option == "--frame-stats") {
+            // start with the frame timing overlay shown
+            showFrameStats = true;
+        } else {
+            // the image (or tile pyramid) to show first
+            image_path = option;
+        }
+    }
+    
+    SetTraceThreadName("main");
+    
     // initialize the GLFW windowing system
     if (!glfwInit()) {
         cout << "ERROR: GLFW failed to initialize, TERMINATING" << endl;
@@ -555,7 +675,7 @@ int main(int argc, char *argv[])
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     int width = 512, height = 512;
-    window = glfwCreateWindow(width, height, "CPSC 453 OpenGL Boilerplate", 0, 0);
+    window = glfwCreateWindow(width, height, WINDOW_TITLE, 0, 0);
     if (!window) {
         cout << "Program failed to create GLFW window, TERMINATING" << endl;
         glfwTerminate();
@@ -569,6 +689,7 @@ int main(int argc, char *argv[])
     glfwSetMouseButtonCallback( window, mouseButtonCallback );
     glfwSetInputMode( window, GLFW_STICKY_MOUSE_BUTTONS, 1 );
     glfwSetScrollCallback( window, scrollCallback );
+    glfwSetWindowRefreshCallback( window, windowRefreshCallback );
     
     // set keyboard callback function and make our context current (active)
     glfwSetKeyCallback(window, KeyCallback);
@@ -583,13 +704,20 @@ int main(int argc, char *argv[])
     
     // query and print out information about our OpenGL environment
     QueryGLVersion();
+    InitializeFrameStats(&frameStats);
+    maxTextureSize = maxTextureSize > 0 ? std::min(maxTextureSize, MaxTextureSize()) : MaxTextureSize();
     
     // call function to load and compile shader programs
-    GLuint program = InitializeShaders();
-    if (program == 0) {
+    DisplayProgram display;
+    if (!InitializeShaders(&display)) {
         cout << "Program could not initialize shaders, TERMINATING" << endl;
         return -1;
     }
+    DisplayProgram tiledDisplay[VARIANT_COUNT];
+    ShaderVariant tiledVariant = VARIANT_ORIGINAL;
+    if (!InitializeTiledShaders(tiledDisplay)) {
+        cout << "Program could not initialize the tiled image shaders!" << endl;
+    }
     
     textureCoords.push_back(vec2(0.0f, 1.0f));
     textureCoords.push_back(vec2(1.0f, 1.0f));
@@ -611,40 +739,254 @@ int main(int argc, char *argv[])
         cout << "Program failed to intialize geometry!" << endl;
     }
     
-    // set the initial values of the luminance to 1
-    luminanceValues.r = 1;
-    luminanceValues.g = 1;
-    luminanceValues.b = 1;
-
-    const char* tmp_image_path = image_path.c_str();
-    if (!InitializeTexture(&myTexture, tmp_image_path)) {
-        cout << "Program failed to initialize texture!" << endl;
+    BlurPass blurPass;
+    if (!InitializeBlurPass(&blurPass)) {
+        cout << "Program failed to initialize the blur pass!" << endl;
     }
     
-    addVertices(myTexture);
+    FilterPass filterPass;
+    if (!InitializeFilterPass(&filterPass)) {
+        cout << "Program failed to initialize the filter pass!" << endl;
+    }
+    const MyTexture *displayTexture = &myTexture;
+    
+    // a JPEG much larger than the window is first decoded at a reduced
+    // size, and in full once it is zoomed in past that
+    InitializePixelCache(&pixelCache, pixelCacheDirectory, pixelCacheBytes);
+    imageLoader.maxTextureSize = maxTextureSize;
+    imageLoader.pixelCache = &pixelCache;
+    glfwGetFramebufferSize(window, &imageLoader.previewWidth, &imageLoader.previewHeight);
+    
+    // the first image is decoded before the window shows anything; a tile
+    // pyramid only needs its index and coarsest tile
+    startLoadTiming(image_path);
+    if (IsTilePyramidPath(image_path)) {
+        showTilePyramid(image_path);
+    } else {
+        ImageRequest firstRequest;
+        firstRequest.path = image_path;
+        firstRequest.preview = true;
+        DecodedImage first;
+        LoadImagePixels(&imageLoader, firstRequest, &first);
+        if (first.pixels.data) {
+            showDecodedImage(image_path, &first.pixels, first.scale);
+        } else {
+            cout << "Program failed to initialize texture!" << endl;
+        }
+    }
+    
+    // the others decode in the background, straight into the upload ring,
+    // waking the main loop when done
+    if (!InitializePixelUploader(&pixelUploader, DEFAULT_UPLOAD_SLOT_BYTES)) {
+        cout << "Program failed to initialize the pixel upload ring!" << endl;
+    }
+    InitializeImageLoader(&imageLoader, 2, []() { glfwPostEmptyEvent(); }, &pixelUploader);
+    
+    // the box and recursive blurs run on the CPU, away from the window
+    CpuBlurWorker cpuBlur;
+    InitializeCpuBlurWorker(&cpuBlur, &pixelCache, []() { glfwPostEmptyEvent(); });
     
     // run an event-triggered main loop
+    double titleTime = 0;
+    bool idle = false;
     while (!glfwWindowShouldClose(window)) {
-        glUseProgram(program);
+        // nothing changed last time round: sleep until the next event, before
+        // the frame's timers start, so the wait is never part of a frame
+        if (idle) glfwWaitEvents();
+        idle = false;
+        BeginFrame(&frameStats);
+        CollectThumbnails(&thumbnails);
         
-        if(!LoadGeometry(&geometry, 6)) {
-            cout << "Failed to load geometry" << endl;
+        // upload an image the loader threads have finished decoding; from a
+        // slot of the ring glTexImage2D returns before the copy is done
+        RecycleUploadSlots(&pixelUploader);
+        DecodedImage decoded;
+        if (TakeDecodedImage(&imageLoader, &decoded)) {
+            if (decoded.pixels.width > 0) {
+                cout << (decoded.fromCache ? "Mapped " : "Decoded ") << decoded.path << " (" << decoded.pixels.width << " x "
+                     << decoded.pixels.height << ") in " << decoded.decodeMs << " ms, after waiting "
+                     << decoded.waitMs << " ms" << (decoded.scale > 1 ? ", reduced 1/" + to_string(decoded.scale) : "")
+                     << (decoded.uploadSlot >= 0 ? ", uploaded through the ring" : "") << endl;
+            }
+            if (decoded.uploadSlot >= 0) {
+                // pixels.data is null, i.e. offset 0 of the bound slot
+                BeginSlotUpload(&pixelUploader, decoded.uploadSlot);
+                const MyTexture *texture = AddCachedTexture(&textureCache, decoded.path, decoded.pixels, decoded.scale);
+                EndSlotUpload(&pixelUploader, decoded.uploadSlot);
+                DestroyPixels(&decoded.pixels);
+                
+                if (texture) {
+                    ReadBackThumbnail(&thumbnails, decoded.path, *texture);
+                    showImage(decoded.path, *texture, decoded.scale);
+                } else {
+                    cout << "Program failed to initialize texture!" << endl;
+                }
+            } else if (decoded.pixels.data) {
+                showDecodedImage(decoded.path, &decoded.pixels, decoded.scale);
+            } else {
+                cout << "Program failed to initialize texture!" << endl;
+            }
+        }
+        
+        // a CPU blur of the image on show is cached like any texture, with
+        // the image's own texture kept ahead of it in the eviction order
+        CpuBlurResult blur;
+        if (TakeCpuBlur(&cpuBlur, &blur) && blur.request.path == image_path) {
+            cout << "Blurred " << blur.request.path << " (sigma " << blur.request.sigma << ") in "
+                 << blur.blurMs << " ms" << endl;
+            MyPixels pixels;
+            pixels.data = &blur.bytes[0];
+            pixels.width = blur.width;
+            pixels.height = blur.height;
+            pixels.components = 4;
+            FindCachedTexture(&textureCache, image_path);
+            AddCachedTexture(&textureCache, CpuBlurKey(blur.request), pixels);
+            filterParamsChanged = true;
+        }
+        
+        if (geometryChanged) {
+            BeginCpuTimer(&frameStats, TIMER_GEOMETRY);
+            if(!LoadGeometry(&geometry, 6)) {
+                cout << "Failed to load geometry" << endl;
+            }
+            EndCpuTimer(&frameStats, TIMER_GEOMETRY);
+            geometryChanged = false;
+            sceneChanged = true;
         }
     
-        // call function to draw our scene
-        RenderScene(&geometry, &myTexture, program);
-        glfwGetCursorPos( window, &xpos, &ypos );
+        // the effect is applied once at image resolution, and the result
+        // drawn until the image or the effect changes
+        if (filterParamsChanged) {
+            BeginGpuTimer(&frameStats, TIMER_FILTER_GPU);
+            displayTexture = &myTexture;
+            if (IsTiled(tiledTexture)) {
+                // a tiled image is filtered as its tiles are drawn, and only
+                // by the effects of fragment.glsl
+                tiledVariant = SelectVariant(filterParams);
+                BeginCpuTimer(&frameStats, TIMER_UNIFORMS);
+                UpdateFilterUniforms(&filterPass, filterParams, tiledTexture.width, tiledTexture.height);
+                EndCpuTimer(&frameStats, TIMER_UNIFORMS);
+                if (SelectEffect(filterParams) >= EFFECT_GAUSS) {
+                    cout << "Blurs are not available for tiled images, showing it unblurred (use --batch to blur it)" << endl;
+                }
+            } else if (filterParams.doGauss > 0) {
+                MyTexture *blurred = RenderGaussianBlur(&blurPass, myTexture, GaussSigma(filterParams) * myTexture.width / imageWidth);
+                if (blurred) displayTexture = blurred;
+            } else if (filterParams.doBoxBlur > 0 || filterParams.doRecursiveGauss > 0) {
+                // the unblurred image stays on show until the blur is done
+                CpuBlurRequest request;
+                request.path = image_path;
+                request.sigma = GaussSigma(filterParams);
+                request.recursive = filterParams.doRecursiveGauss > 0;
+                const MyTexture *blurred = FindCachedTexture(&textureCache, CpuBlurKey(request));
+                if (blurred) {
+                    displayTexture = blurred;
+                } else {
+                    RequestCpuBlur(&cpuBlur, request);
+                }
+            } else {
+                BeginCpuTimer(&frameStats, TIMER_UNIFORMS);
+                UpdateFilterUniforms(&filterPass, filterParams, myTexture.width, myTexture.height);
+                EndCpuTimer(&frameStats, TIMER_UNIFORMS);
+                const MyTexture *filtered = RenderFilter(&filterPass, myTexture, filterParams);
+                if (filtered) displayTexture = filtered;
+            }
+            EndGpuTimer(&frameStats, TIMER_FILTER_GPU);
+            filterParamsChanged = false;
+            sceneChanged = true;
+        }
+        
+        // every timed step above changes the scene, so a pass that changed
+        // nothing has no timings to lose by skipping EndFrame()
+        if (!sceneChanged) {
+            idle = true;
+            continue;
+        }
+        sceneChanged = false;
         
+        // panning, zooming and rotating just draw the cached result, or the
+        // tiles of a tiled image at the zoom, streaming in any that are
+        // missing over the next frames
+        BeginCpuTimer(&frameStats, TIMER_UNIFORMS);
+        UpdateTransform();
+        EndCpuTimer(&frameStats, TIMER_UNIFORMS);
+        if (IsTiled(tiledTexture)) {
+            float region[4], texelsPerPixel;
+            VisibleRegion(window, region, &texelsPerPixel);
+            int level = TileLevelForScale(tiledTexture, texelsPerPixel);
+            BeginGpuTimer(&frameStats, TIMER_TILES_GPU);
+            bool complete = UpdateTileResidency(&tiledTexture, region, level, MAX_TILE_UPLOADS_PER_FRAME);
+            EndGpuTimer(&frameStats, TIMER_TILES_GPU);
+            if (!complete) {
+                sceneChanged = true;
+            } else {
+                markImageShown(image_path, "tiles", true);
+            }
+            BeginGpuTimer(&frameStats, TIMER_SCENE_GPU);
+            BeginCpuTimer(&frameStats, TIMER_SCENE_CPU);
+            RenderScene(&geometry, &tiledTexture.atlas, tiledDisplay[tiledVariant], &tiledTexture);
+            EndCpuTimer(&frameStats, TIMER_SCENE_CPU);
+            EndGpuTimer(&frameStats, TIMER_SCENE_GPU);
+        } else {
+            // a preview drawn larger than its texels: decode the full image
+            if (myTexture.width < imageWidth && !fullSizeRequested) {
+                float region[4], texelsPerPixel;
+                VisibleRegion(window, region, &texelsPerPixel);
+                if (texelsPerPixel < 1.0f) {
+                    RequestImage(&imageLoader, image_path);
+                    fullSizeRequested = true;
+                }
+            }
+            BeginGpuTimer(&frameStats, TIMER_SCENE_GPU);
+            BeginCpuTimer(&frameStats, TIMER_SCENE_CPU);
+            RenderScene(&geometry, displayTexture, display);
+            EndCpuTimer(&frameStats, TIMER_SCENE_CPU);
+            EndGpuTimer(&frameStats, TIMER_SCENE_GPU);
+        }
         
-        glfwSwapBuffers(window);
+        // the overlay's numbers go in the title, twice a second at most
+        if (showFrameStats) {
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            DrawFrameStatsOverlay(frameStats, framebufferWidth);
+            if (glfwGetTime() - titleTime > 0.5) {
+                glfwSetWindowTitle(window, FrameStatsSummary(frameStats).c_str());
+                titleTime = glfwGetTime();
+            }
+            sceneChanged = true;
+        }
+        
+        BeginCpuTimer(&frameStats, TIMER_SWAP);
+        {
+            TraceSpan span("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
+        EndCpuTimer(&frameStats, TIMER_SWAP);
+        logLoadTiming();
+        EndFrame(&frameStats);
         
         glfwPollEvents();
     }
     
     // clean up allocated resources before exit
+    DestroyImageLoader(&imageLoader);
+    DestroyCpuBlurWorker(&cpuBlur);
+    closeTiledImage();
+    closePreview();
+    DestroyThumbnailCache(&thumbnails);
+    DestroyPixelUploader(&pixelUploader);
+    PrintTextureCacheStats(textureCache);
+    PrintPixelCacheStats(pixelCache);
+    PrintFrameStats(frameStats);
+    if (TracingEnabled()) WriteTrace(tracePath.c_str());
+    DestroyFrameStats(&frameStats);
+    DestroyTextureCache(&textureCache);
+    DestroyFilterPass(&filterPass);
+    DestroyBlurPass(&blurPass);
     DestroyGeometry(&geometry);
     glUseProgram(0);
-    glDeleteProgram(program);
+    glDeleteProgram(display.program);
+    for (const DisplayProgram &tiled : tiledDisplay) glDeleteProgram(tiled.program);
     glfwDestroyWindow(window);
     glfwTerminate();
     
@@ -695,84 +1037,220 @@ bool CheckGLErrors()
     return error;
 }
 
-// --------------------------------------------------------------------------
-// OpenGL shader support functions
-
-// reads a text file with the given name into a string
-string LoadSource(const string &filename)
+// shows the image at path at once if it was viewed before, otherwise asks
+// the loader threads to decode it and shows its thumbnail, if there is one,
+// until they are done (see the main loop)
+void loadImage(const string &path)
 {
-    string source;
+    startLoadTiming(path);
     
-    ifstream input(filename.c_str());
-    if (input) {
-        copy(istreambuf_iterator<char>(input),
-             istreambuf_iterator<char>(),
-             back_inserter(source));
-        input.close();
+    // tile pyramids read only their index up front, so open them here
+    if (IsTilePyramidPath(path)) {
+        CancelImageRequests(&imageLoader);
+        showTilePyramid(path);
+        return;
     }
-    else {
-        cout << "ERROR: Could not load shader source from file "
-        << filename << endl;
+    
+    int scale = 1;
+    const MyTexture *texture = FindCachedTexture(&textureCache, path, &scale);
+    if (texture) {
+        CancelImageRequests(&imageLoader);
+        showImage(path, *texture, scale);
+        return;
     }
     
-    return source;
+    RequestImage(&imageLoader, path, true);
+    CollectThumbnails(&thumbnails);
+    MyPixels exif;
+    const MyPixels *thumbnail = FindThumbnail(thumbnails, path);
+    if (thumbnail) {
+        showPreview(path, *thumbnail, "thumbnail");
+    } else if (IsJpegPath(path) && ReadExifThumbnail(&exif, path.c_str())) {
+        showPreview(path, exif, "EXIF thumbnail");
+        DestroyPixels(&exif);
+    }
 }
 
-// creates and returns a shader object compiled from the given source
-GLuint CompileShader(GLenum shaderType, const string &source)
+void showImage(const string &path, const MyTexture &texture, int scale)
 {
-    // allocate shader object name
-    GLuint shaderObject = glCreateShader(shaderType);
-    
-    // try compiling the source as a shader of the given type
-    const GLchar *source_ptr = source.c_str();
-    glShaderSource(shaderObject, 1, &source_ptr, 0);
-    glCompileShader(shaderObject);
-    
-    // retrieve compile status
-    GLint status;
-    glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &status);
-    if (status == GL_FALSE)
-    {
-        GLint length;
-        glGetShaderiv(shaderObject, GL_INFO_LOG_LENGTH, &length);
-        string info(length, ' ');
-        glGetShaderInfoLog(shaderObject, info.length(), &length, &info[0]);
-        cout << "ERROR compiling shader:" << endl << endl;
-        cout << source << endl;
-        cout << info << endl;
+    closeTiledImage();
+    if (texture.textureID != previewTexture.textureID) closePreview();
+    image_path = path;
+    myTexture = texture;
+    imageWidth = texture.width;
+    imageHeight = texture.height;
+    if (scale > 1 && !ReadImageSize(path.c_str(), &imageWidth, &imageHeight)) {
+        imageWidth = texture.width * scale;
+        imageHeight = texture.height * scale;
     }
-    
-    return shaderObject;
+    fullSizeRequested = false;
+    
+    // the quad has the full image's proportions whichever version is on it,
+    // so swapping in a sharper one does not move or resize it
+    MyTexture fullSize;
+    fullSize.width = imageWidth;
+    fullSize.height = imageHeight;
+    addVertices(fullSize);
+    filterParamsChanged = true;
+    markImageShown(path, scale > 1 ? "1/" + to_string(scale) + " preview" : "full image", scale == 1);
 }
 
-// creates and returns a program object linked from vertex and fragment shaders
-GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader)
+// uploads freshly decoded pixels and shows them, drawing them from tiles if
+// they are too big for one texture; the pixels are released either way
+void showDecodedImage(const string &path, MyPixels *pixels, int scale)
 {
-    // allocate program object name
-    GLuint programObject = glCreateProgram();
+    if (std::max(pixels->width, pixels->height) <= maxTextureSize) {
+        const MyTexture *texture = AddCachedTexture(&textureCache, path, *pixels, scale);
+        DestroyPixels(pixels);
+        if (texture) {
+            ReadBackThumbnail(&thumbnails, path, *texture);
+            showImage(path, *texture, scale);
+        } else {
+            cout << "Program failed to initialize texture!" << endl;
+        }
+        return;
+    }
     
-    // attach provided shader objects to this program
-    if (vertexShader)   glAttachShader(programObject, vertexShader);
-    if (fragmentShader) glAttachShader(programObject, fragmentShader);
+    closeTiledImage();
+    if (!InitializeTiledTexture(&tiledTexture, pixels)) {
+        cout << "Program failed to initialize tiled texture!" << endl;
+        DestroyTiledTexture(&tiledTexture);
+        return;
+    }
     
-    // try linking the program with given attachments
-    glLinkProgram(programObject);
+    // the coarsest level fits in a tile, so its thumbnail is quick to make
+    if (!FindThumbnail(thumbnails, path)) {
+        const TileLevel &coarsest = tiledTexture.levels.back();
+        MyPixels level, thumbnail;
+        level.data = (unsigned char *)coarsest.data;
+        level.width = coarsest.width;
+        level.height = coarsest.height;
+        level.components = tiledTexture.components;
+        MakeThumbnail(level, &thumbnail);
+        AddThumbnail(&thumbnails, path, &thumbnail);
+    }
     
-    // retrieve link status
-    GLint status;
-    glGetProgramiv(programObject, GL_LINK_STATUS, &status);
-    if (status == GL_FALSE)
-    {
-        GLint length;
-        glGetProgramiv(programObject, GL_INFO_LOG_LENGTH, &length);
-        string info(length, ' ');
-        glGetProgramInfoLog(programObject, info.length(), &length, &info[0]);
-        cout << "ERROR linking shader program:" << endl;
-        cout << info << endl;
+    // tiles are drawn at full size, so a preview is only a stopgap
+    if (scale > 1) RequestImage(&imageLoader, path);
+    showTiledImage(path);
+}
+
+// shows a thumbnail, stretched over the size the full image will have,
+// while that decodes
+void showPreview(const string &path, const MyPixels &pixels, const char *source)
+{
+    int width, height;
+    if (!ReadImageSize(path.c_str(), &width, &height)) return;
+    
+    // a camera's thumbnail of a photo cropped since would come out stretched
+    float proportions = ((float)pixels.width / pixels.height) / ((float)width / height);
+    if (proportions < 0.95f || proportions > 1.05f) return;
+    
+    closeTiledImage();
+    closePreview();
+    if (!InitializeTexture(&previewTexture, pixels)) {
+        closePreview();
+        return;
     }
     
-    return programObject;
+    image_path = path;
+    myTexture = previewTexture;
+    imageWidth = width;
+    imageHeight = height;
+    fullSizeRequested = true;
+    
+    MyTexture fullSize;
+    fullSize.width = imageWidth;
+    fullSize.height = imageHeight;
+    addVertices(fullSize);
+    filterParamsChanged = true;
+    markImageShown(path, source, false);
+}
+
+// opens a tile pyramid file and shows it as a tiled image
+void showTilePyramid(const string &path)
+{
+    closeTiledImage();
+    if (!InitializeTiledTexture(&tiledTexture, path.c_str())) {
+        cout << "Program failed to open tile pyramid!" << endl;
+        DestroyTiledTexture(&tiledTexture);
+        return;
+    }
+    showTiledImage(path);
+}
+
+// shows the image now in tiledTexture
+void showTiledImage(const string &path)
+{
+    closePreview();
+    
+    // only the size, for the geometry and mouse movement
+    image_path = path;
+    myTexture = MyTexture();
+    myTexture.width = tiledTexture.width;
+    myTexture.height = tiledTexture.height;
+    imageWidth = tiledTexture.width;
+    imageHeight = tiledTexture.height;
+    addVertices(myTexture);
+    filterParamsChanged = true;
+    markImageShown(path, "coarsest tiles", false);
+}
+
+// releases the tiled image, if one is shown
+void closeTiledImage()
+{
+    if (IsTiled(tiledTexture)) {
+        PrintTiledTextureStats(tiledTexture);
+        DestroyTiledTexture(&tiledTexture);
+    }
+}
+
+// releases the thumbnail texture, if one was shown
+void closePreview()
+{
+    if (previewTexture.textureID != 0) DestroyTexture(&previewTexture);
+    previewTexture = MyTexture();
+}
+
+// --------------------------------------------------------------------------
+// Load timing
+
+void startLoadTiming(const string &path)
+{
+    loadTiming = LoadTiming();
+    loadTiming.path = path;
+    loadTiming.start = chrono::steady_clock::now();
+}
+
+// notes that a version of the image was put on screen, sharp if it is the
+// full-size one
+void markImageShown(const string &path, const string &source, bool sharp)
+{
+    if (path != loadTiming.path) return;
+    if (!loadTiming.firstLogged && !loadTiming.firstPending) {
+        loadTiming.firstPending = true;
+        loadTiming.firstSource = source;
+    }
+    if (sharp) {
+        loadTiming.sharpPending = true;
+        loadTiming.sharpSource = source;
+    }
+}
+
+// prints what was shown in the frame just swapped, as time from the switch
+void logLoadTiming()
+{
+    if (loadTiming.path.empty()) return;
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - loadTiming.start).count();
+    if (loadTiming.firstPending) {
+        cout << "First pixels of " << loadTiming.path << " after " << ms << " ms (" << loadTiming.firstSource << ")" << endl;
+        loadTiming.firstPending = false;
+        loadTiming.firstLogged = true;
+    }
+    if (loadTiming.sharpPending) {
+        cout << "Full resolution of " << loadTiming.path << " after " << ms << " ms (" << loadTiming.sharpSource << ")" << endl;
+        loadTiming.path.clear();
+    }
 }
 
 void addVertices(MyTexture incomingTexture)
@@ -794,4 +1272,6 @@ void addVertices(MyTexture incomingTexture)
     vertices.push_back(vec2(initImageWidth, -initImageHeight));
     vertices.push_back(vec2(initImageWidth, initImageHeight));
     vertices.push_back(vec2(-initImageWidth, -initImageHeight));
+    
+    geometryChanged = true;
 }
@@ -0,0 +1,235 @@
+#include "offscreen.h"
+#include "batch.h"
+#include "blur.h"
+#include "filterpass.h"
+#include "filters.h"
+#include "trace.h"
+#include <stb/stb_image_write.h>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+using namespace std;
+
+OffscreenContext::OffscreenContext() : display(nullptr), context(nullptr), surface(nullptr), window(nullptr)
+	{}
+
+#ifdef HAVE_EGL
+
+static bool HasExtension(const char *extensions, const char *name)
+{
+	if (!extensions) return false;
+	size_t length = strlen(name);
+	for (const char *found = strstr(extensions, name); found; found = strstr(found + length, name)) {
+		if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == '\0')) return true;
+	}
+	return false;
+}
+
+// Mesa's surfaceless platform needs no X server or DRM master; the default
+// display is the fallback for other drivers
+static EGLDisplay OpenDisplay()
+{
+	const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay) {
+			EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+			if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) return display;
+		}
+	}
+	EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) return display;
+	return EGL_NO_DISPLAY;
+}
+
+bool InitializeOffscreenContext(OffscreenContext *offscreen)
+{
+	EGLDisplay display = OpenDisplay();
+	if (display == EGL_NO_DISPLAY || !eglBindAPI(EGL_OPENGL_API)) {
+		cout << "Could not open an EGL display for OpenGL" << endl;
+		return false;
+	}
+	offscreen->display = display;
+
+	// without surfaceless contexts a 1 x 1 pbuffer is made current instead;
+	// either way everything is drawn into framebuffer objects
+	bool surfaceless = HasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+	const EGLint configAttributes[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configCount = 0;
+	if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+		cout << "No EGL config renders with OpenGL" << endl;
+		DestroyOffscreenContext(offscreen);
+		return false;
+	}
+
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 1,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE,
+		EGL_NONE
+	};
+	offscreen->context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+	if (offscreen->context == EGL_NO_CONTEXT) {
+		cout << "Could not create an OpenGL 4.1 context with EGL (error 0x" << hex << eglGetError() << dec << ")" << endl;
+		DestroyOffscreenContext(offscreen);
+		return false;
+	}
+
+	if (!surfaceless) {
+		const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		offscreen->surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+		if (offscreen->surface == EGL_NO_SURFACE) {
+			cout << "Could not create an EGL pbuffer" << endl;
+			DestroyOffscreenContext(offscreen);
+			return false;
+		}
+	}
+
+	EGLSurface surface = offscreen->surface ? (EGLSurface)offscreen->surface : EGL_NO_SURFACE;
+	if (!eglMakeCurrent(display, surface, surface, (EGLContext)offscreen->context) ||
+		!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+		cout << "Could not make the EGL context current" << endl;
+		DestroyOffscreenContext(offscreen);
+		return false;
+	}
+	return true;
+}
+
+void DestroyOffscreenContext(OffscreenContext *offscreen)
+{
+	if (offscreen->display) {
+		EGLDisplay display = (EGLDisplay)offscreen->display;
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (offscreen->surface) eglDestroySurface(display, (EGLSurface)offscreen->surface);
+		if (offscreen->context) eglDestroyContext(display, (EGLContext)offscreen->context);
+		eglTerminate(display);
+	}
+	*offscreen = OffscreenContext();
+}
+
+#elif defined(__APPLE__)
+
+// macOS has no EGL; a hidden window still needs a logged-in session
+bool InitializeOffscreenContext(OffscreenContext *offscreen)
+{
+	if (!glfwInit()) {
+		cout << "Could not initialize GLFW for an offscreen context" << endl;
+		return false;
+	}
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	offscreen->window = glfwCreateWindow(64, 64, "Offscreen", 0, 0);
+	if (!offscreen->window) {
+		cout << "Could not create a hidden window for OpenGL 4.1" << endl;
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(offscreen->window);
+	if (!gladLoadGL()) {
+		DestroyOffscreenContext(offscreen);
+		return false;
+	}
+	return true;
+}
+
+void DestroyOffscreenContext(OffscreenContext *offscreen)
+{
+	if (offscreen->window) {
+		glfwDestroyWindow(offscreen->window);
+		glfwTerminate();
+	}
+	*offscreen = OffscreenContext();
+}
+
+#else
+#error "The offscreen context needs EGL here: define HAVE_EGL and link libEGL (CMakeLists.txt does)"
+#endif
+
+// the passes the viewer runs for the effect, into render targets at the
+// texture's size; null if the effect is not done on the GPU
+static const MyTexture *RenderEffect(FilterPass *filterPass, BlurPass *blurPass, const MyTexture &source,
+	const FilterParams &params)
+{
+	FilterEffect effect = SelectEffect(params);
+	if (effect == EFFECT_GAUSS) {
+		// the viewer blurs wide sigmas on a smaller mipmap level; without
+		// the mipmaps the blur runs on the full image
+		MyTexture base = source;
+		base.levels = 1;
+		return RenderGaussianBlur(blurPass, base, GaussSigma(params));
+	}
+	if (effect > EFFECT_GAUSS) return nullptr;
+
+	UpdateFilterUniforms(filterPass, params, source.width, source.height);
+	return RenderFilter(filterPass, source, params);
+}
+
+int RenderEffectOffscreen(const char *inputPath, char effectKey, const char *outputPath)
+{
+	FilterParams params;
+	if (!FilterPreset(effectKey, &params)) {
+		cout << "Unknown effect " << effectKey << ", use one of Z X C V S A D L K J" << endl;
+		return 1;
+	}
+
+	OffscreenContext offscreen;
+	if (!InitializeOffscreenContext(&offscreen)) return 1;
+	cout << "OpenGL " << glGetString(GL_VERSION) << ", " << glGetString(GL_RENDERER) << endl;
+
+	MyTexture source;
+	FilterPass filterPass;
+	BlurPass blurPass;
+	MyImage result;
+	bool succeeded = InitializeTexture(&source, inputPath) && InitializeFilterPass(&filterPass) &&
+		InitializeBlurPass(&blurPass);
+	if (succeeded) {
+		const MyTexture *rendered = RenderEffect(&filterPass, &blurPass, source, params);
+		if (!rendered) {
+			cout << FilterPresetName(effectKey) << " runs on the CPU only, use --batch for it" << endl;
+			succeeded = false;
+		} else {
+			// the result is read back as floats, bottom row first like MyImage
+			TraceSpan span("read back");
+			InitializeImage(&result, rendered->width, rendered->height);
+			glPixelStorei(GL_PACK_ALIGNMENT, 4);
+			glBindTexture(GL_TEXTURE_2D, rendered->textureID);
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, result.pixels.data());
+			glBindTexture(GL_TEXTURE_2D, 0);
+			succeeded = !CheckGLErrors("Reading back the effect: ");
+		}
+	}
+
+	DestroyBlurPass(&blurPass);
+	DestroyFilterPass(&filterPass);
+	DestroyTexture(&source);
+	DestroyOffscreenContext(&offscreen);
+
+	if (succeeded) {
+		vector<unsigned char> bytes;
+		stbi_flip_vertically_on_write(1);
+		succeeded = WriteImage(result, outputPath, &bytes);
+		if (succeeded) {
+			cout << FilterPresetName(effectKey) << ": " << result.width << " x " << result.height << " written to "
+				 << outputPath << endl;
+		} else {
+			cout << "Could not write " << outputPath << endl;
+		}
+	}
+	return succeeded ? 0 : 1;
+}
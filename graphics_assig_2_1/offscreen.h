@@ -0,0 +1,38 @@
+#pragma once
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// OpenGL without a window, so the effects of fragment.glsl can run on
+// machines with no display
+//
+// On Linux (HAVE_EGL, defined by CMakeLists.txt along with linking libEGL)
+// the context comes from EGL on Mesa's surfaceless platform (llvmpipe when
+// there is no GPU), falling back to the default display, and renders only
+// into framebuffer objects. macOS has no EGL, so there it is a hidden GLFW
+// window.
+
+struct OffscreenContext
+{
+	// EGL handles (EGLDisplay, EGLContext and EGLSurface are pointers)
+	void *display;
+	void *context;
+	void *surface;		// a 1 x 1 pbuffer, only if surfaceless contexts are not supported
+
+	// the hidden window on macOS
+	GLFWwindow *window;
+
+	// initialize to no context
+	OffscreenContext();
+};
+
+// creates an OpenGL 4.1 core context, makes it current and loads glad
+bool InitializeOffscreenContext(OffscreenContext *offscreen);
+
+// deallocate the context, and the window or display behind it
+void DestroyOffscreenContext(OffscreenContext *offscreen);
+
+// applies the preset of effectKey (one of the fragment.glsl effects or the
+// Gaussian blurs) to the image at its full resolution in an offscreen
+// context, reads the result back and writes it to outputPath (as a JPEG for
+// .jpg or .jpeg, as PNG otherwise). Returns the process exit code.
+int RenderEffectOffscreen(const char *inputPath, char effectKey, const char *outputPath);
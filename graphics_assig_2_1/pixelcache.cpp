@@ -0,0 +1,290 @@
+#include "pixelcache.h"
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char PIXEL_CACHE_MAGIC[4] = { 'P', 'X', 'C', '1' };
+static const uint32_t PIXEL_CACHE_VERSION = 2;
+static const char PIXEL_CACHE_EXTENSION[] = ".pix";
+
+PixelCache::PixelCache() : maxBytes(DEFAULT_PIXEL_CACHE_BYTES), hits(0), misses(0), rebuilds(0), evictions(0)
+	{}
+
+// nanoseconds, as one-second times miss a rewrite within the same second
+static int64_t ModifiedNanoseconds(const struct stat &info)
+{
+#ifdef __APPLE__
+	const struct timespec &modified = info.st_mtimespec;
+#else
+	const struct timespec &modified = info.st_mtim;
+#endif
+	return (int64_t)modified.tv_sec * 1000000000 + modified.tv_nsec;
+}
+
+struct CachedEntry
+{
+	string path;
+	size_t bytes;
+	int64_t lastUsed;
+};
+
+// deletes the least recently used entries (by modification time, which
+// every hit updates) until the rest fit in maxBytes; keep, if given, is
+// never deleted
+static void EvictEntries(PixelCache *cache, const string &keep)
+{
+	lock_guard<mutex> guard(cache->evictionLock);
+	DIR *dir = opendir(cache->directory.c_str());
+	if (!dir) return;
+
+	vector<CachedEntry> entries;
+	size_t totalBytes = 0;
+	size_t extensionLength = sizeof(PIXEL_CACHE_EXTENSION) - 1;
+	while (dirent *found = readdir(dir)) {
+		string name = found->d_name;
+		struct stat info;
+		string path = cache->directory + "/" + name;
+		if (name.size() <= extensionLength || name.compare(name.size() - extensionLength, extensionLength, PIXEL_CACHE_EXTENSION) != 0 ||
+			stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+			continue;
+		}
+		entries.push_back({ path, (size_t)info.st_size, ModifiedNanoseconds(info) });
+		totalBytes += (size_t)info.st_size;
+	}
+	closedir(dir);
+	if (totalBytes <= cache->maxBytes) return;
+
+	sort(entries.begin(), entries.end(), [](const CachedEntry &a, const CachedEntry &b) { return a.lastUsed < b.lastUsed; });
+	for (const CachedEntry &entry : entries) {
+		if (totalBytes <= cache->maxBytes) break;
+		if (entry.path == keep) continue;
+		// a mapping of the entry stays valid after it is deleted
+		if (remove(entry.path.c_str()) == 0) {
+			totalBytes -= entry.bytes;
+			cache->evictions++;
+		}
+	}
+}
+
+bool InitializePixelCache(PixelCache *cache, const string &directory, size_t maxBytes)
+{
+	cache->directory = directory;
+	cache->maxBytes = maxBytes;
+	if (directory.empty()) return true;
+	if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+		cout << "Could not create the pixel cache directory " << directory << ": " << strerror(errno) << endl;
+		cache->directory.clear();
+		return false;
+	}
+	EvictEntries(cache, "");
+	return true;
+}
+
+// 64-bit FNV-1a
+static uint64_t HashPath(const string &path)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (unsigned char c : path) {
+		hash = (hash ^ c) * 1099511628211ull;
+	}
+	return hash;
+}
+
+// the header an up to date entry for the source file has, without the size
+// of the image; false if the source cannot be found
+static bool SourceHeader(const char *filename, PixelCacheHeader *header)
+{
+	struct stat source;
+	if (stat(filename, &source) != 0) return false;
+
+	// the same file under another relative path shares its entry
+	char fullPath[PATH_MAX];
+	string path = realpath(filename, fullPath) ? fullPath : filename;
+
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, PIXEL_CACHE_MAGIC, sizeof(header->magic));
+	header->version = PIXEL_CACHE_VERSION;
+	header->pathHash = HashPath(path);
+	header->sourceBytes = (uint64_t)source.st_size;
+	header->sourceModified = ModifiedNanoseconds(source);
+	return true;
+}
+
+static string EntryPath(const PixelCache &cache, const PixelCacheHeader &header)
+{
+	ostringstream name;
+	name << cache.directory << "/" << hex << setw(16) << setfill('0') << header.pathHash << PIXEL_CACHE_EXTENSION;
+	return name.str();
+}
+
+// maps the entry if it was written for the same source file; returns false
+// if there is none or it is stale (rebuilt set) or damaged
+static bool MapEntry(const string &entryPath, const PixelCacheHeader &expected, MyPixels *pixels, bool *rebuilt)
+{
+	*rebuilt = false;
+	int file = open(entryPath.c_str(), O_RDONLY);
+	if (file < 0) return false;
+
+	struct stat entry;
+	PixelCacheHeader header;
+	if (fstat(file, &entry) != 0 || pread(file, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+		memcmp(header.magic, PIXEL_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != PIXEL_CACHE_VERSION) {
+		close(file);
+		*rebuilt = true;
+		return false;
+	}
+
+	size_t bytes = sizeof(header) + (size_t)header.width * header.height * header.components;
+	if (header.pathHash != expected.pathHash || header.sourceBytes != expected.sourceBytes ||
+		header.sourceModified != expected.sourceModified || (size_t)entry.st_size != bytes ||
+		header.components < 1 || header.components > 4) {
+		close(file);
+		*rebuilt = true;
+		return false;
+	}
+
+	// private, so anything that writes to the pixels gets its own copy of
+	// the page instead of changing the entry
+	void *mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+
+	// marks the entry as just used, for EvictEntries()
+	futimens(file, nullptr);
+	close(file);
+	if (mapping == MAP_FAILED) return false;
+	madvise(mapping, bytes, MADV_WILLNEED);
+
+	pixels->data = (unsigned char *)mapping + sizeof(header);
+	pixels->width = header.width;
+	pixels->height = header.height;
+	pixels->components = header.components;
+	pixels->mapping = mapping;
+	pixels->mappedBytes = bytes;
+	return true;
+}
+
+PixelCacheEntry::PixelCacheEntry() : cache(nullptr), rowBytes(0)
+	{}
+
+// written under a name of its own and renamed into place, so another thread
+// or process never maps a half-written entry
+static bool OpenEntry(PixelCache *cache, PixelCacheEntry *entry, const string &entryPath, PixelCacheHeader header,
+					  int width, int height, int components)
+{
+	header.width = width;
+	header.height = height;
+	header.components = components;
+
+	ostringstream temporary;
+	temporary << entryPath << "." << getpid() << "." << hash<thread::id>()(this_thread::get_id()) << ".tmp";
+	entry->cache = cache;
+	entry->path = entryPath;
+	entry->temporaryPath = temporary.str();
+	entry->rowBytes = (size_t)width * components;
+	entry->file.open(entry->temporaryPath, ios::binary);
+	entry->file.write((const char *)&header, sizeof(header));
+	return (bool)entry->file;
+}
+
+bool BeginPixelCacheEntry(PixelCache *cache, PixelCacheEntry *entry, const char *filename, int width, int height,
+						  int components)
+{
+	PixelCacheHeader header;
+	if (!cache || cache->directory.empty() || !SourceHeader(filename, &header)) return false;
+
+	string entryPath = EntryPath(*cache, header);
+	cache->misses++;
+	if (access(entryPath.c_str(), F_OK) == 0) cache->rebuilds++;
+	if (!OpenEntry(cache, entry, entryPath, header, width, height, components)) {
+		FinishPixelCacheEntry(entry, false);
+		return false;
+	}
+	return true;
+}
+
+void WritePixelCacheRow(PixelCacheEntry *entry, int y, const unsigned char *row)
+{
+	entry->file.seekp((streamoff)(sizeof(PixelCacheHeader) + (size_t)y * entry->rowBytes));
+	entry->file.write((const char *)row, entry->rowBytes);
+}
+
+void FinishPixelCacheEntry(PixelCacheEntry *entry, bool complete)
+{
+	if (!entry->file.is_open()) return;
+	entry->file.close();
+	if (!complete || !entry->file || rename(entry->temporaryPath.c_str(), entry->path.c_str()) != 0) {
+		if (complete) cout << "Could not write the pixel cache entry " << entry->path << endl;
+		remove(entry->temporaryPath.c_str());
+		return;
+	}
+	if (entry->cache) EvictEntries(entry->cache, entry->path);
+}
+
+static void WriteEntry(PixelCache *cache, const string &entryPath, const PixelCacheHeader &header, const MyPixels &pixels)
+{
+	PixelCacheEntry entry;
+	if (!OpenEntry(cache, &entry, entryPath, header, pixels.width, pixels.height, pixels.components)) {
+		cout << "Could not write the pixel cache entry " << entryPath << endl;
+		FinishPixelCacheEntry(&entry, false);
+		return;
+	}
+	entry.file.write((const char *)pixels.data, (streamsize)pixels.width * pixels.height * pixels.components);
+	FinishPixelCacheEntry(&entry, true);
+}
+
+bool MapCachedPixels(PixelCache *cache, MyPixels *pixels, const char *filename)
+{
+	PixelCacheHeader header;
+	if (!cache || cache->directory.empty() || !SourceHeader(filename, &header)) return false;
+
+	bool rebuilt = false;
+	if (!MapEntry(EntryPath(*cache, header), header, pixels, &rebuilt)) return false;
+	cache->hits++;
+	return true;
+}
+
+bool LoadPixels(PixelCache *cache, MyPixels *pixels, const char *filename, bool *fromCache)
+{
+	if (fromCache) *fromCache = false;
+	PixelCacheHeader header;
+	if (!cache || cache->directory.empty() || !SourceHeader(filename, &header)) {
+		return DecodePixels(pixels, filename);
+	}
+
+	string entryPath = EntryPath(*cache, header);
+	bool rebuilt = false;
+	if (MapEntry(entryPath, header, pixels, &rebuilt)) {
+		cache->hits++;
+		if (fromCache) *fromCache = true;
+		return true;
+	}
+
+	cache->misses++;
+	if (rebuilt) cache->rebuilds++;
+	if (!DecodePixels(pixels, filename)) return false;
+	WriteEntry(cache, entryPath, header, *pixels);
+	return true;
+}
+
+void PrintPixelCacheStats(const PixelCache &cache)
+{
+	if (cache.directory.empty()) return;
+	cout << "Pixel cache: " << cache.hits << " hits, " << cache.misses << " misses ("
+		 << cache.rebuilds << " stale entries rebuilt), " << cache.evictions << " entries evicted" << endl;
+}
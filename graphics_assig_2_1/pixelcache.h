@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// Decoded pixels kept on disk, so opening an image again maps its pixels
+// instead of decoding the file. An entry is a PixelCacheHeader followed by
+// the rows, bottom row first as DecodePixels() makes them. It is mapped into
+// memory and handed out as MyPixels, so texture uploads and the CPU filters
+// read the mapping directly and only pay for paging it in. Entries remember
+// the size and modification time (to the nanosecond) of their source file
+// and are rebuilt when either changes. Once the entries take more than the
+// cache's limit, the least recently used ones are deleted.
+
+const char *const DEFAULT_PIXEL_CACHE_DIRECTORY = ".pixelcache";
+const size_t DEFAULT_PIXEL_CACHE_BYTES = (size_t)2048 * 1024 * 1024;
+
+struct PixelCacheHeader
+{
+	char magic[4];			// "PXC1"
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t components;
+	uint32_t reserved;
+	uint64_t pathHash;		// of the source file's full path
+	uint64_t sourceBytes;
+	int64_t sourceModified;	// nanoseconds since the epoch
+	uint64_t padding[2];	// rows start 64 bytes in
+};
+
+static_assert(sizeof(PixelCacheHeader) == 64, "pixel cache rows must start 64 bytes in");
+
+struct PixelCache
+{
+	std::string directory;	// empty while the cache is off
+	size_t maxBytes;		// of all entries together
+	std::mutex evictionLock;	// one thread trims the directory at a time
+
+	// updated by every loader thread
+	std::atomic<unsigned> hits;
+	std::atomic<unsigned> misses;
+	std::atomic<unsigned> rebuilds;		// misses on entries gone stale
+	std::atomic<unsigned> evictions;
+
+	// initialize to a cache that is off
+	PixelCache();
+};
+
+// creates the directory if needed and trims it to maxBytes; an empty
+// directory turns the cache off
+bool InitializePixelCache(PixelCache *cache, const std::string &directory, size_t maxBytes = DEFAULT_PIXEL_CACHE_BYTES);
+
+// maps the cached pixels of the image if its entry is current, otherwise
+// decodes it and writes a new entry. The cache may be null or off to just
+// decode. fromCache, if given, tells which happened. Release the pixels with
+// DestroyPixels() either way. Safe to call from several threads.
+bool LoadPixels(PixelCache *cache, MyPixels *pixels, const char *filename, bool *fromCache = nullptr);
+
+// an entry being written a row at a time, as the rows are decoded
+struct PixelCacheEntry
+{
+	PixelCache *cache;		// trimmed once the entry is in place
+	std::string path;
+	std::string temporaryPath;	// renamed to path once complete
+	std::ofstream file;
+	size_t rowBytes;
+
+	// initialize to no entry
+	PixelCacheEntry();
+};
+
+// starts an entry for the image (counting a miss, as LoadPixels() would),
+// returning false if the cache is off or the entry cannot be created
+bool BeginPixelCacheEntry(PixelCache *cache, PixelCacheEntry *entry, const char *filename, int width, int height,
+						  int components);
+
+// writes row y, counted from the bottom; rows may come in any order
+void WritePixelCacheRow(PixelCacheEntry *entry, int y, const unsigned char *row);
+
+// puts the entry in place if every row was written, evicting older entries
+// past the cache's limit, otherwise discards it
+void FinishPixelCacheEntry(PixelCacheEntry *entry, bool complete);
+
+// only maps the cached pixels, returning false (and counting nothing) if
+// the image has no current entry
+bool MapCachedPixels(PixelCache *cache, MyPixels *pixels, const char *filename);
+
+// prints the number of hits, misses, rebuilt and evicted entries
+void PrintPixelCacheStats(const PixelCache &cache);
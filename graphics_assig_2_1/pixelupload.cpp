@@ -0,0 +1,156 @@
+#include "pixelupload.h"
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+// ARB_buffer_storage, core in GL 4.4 and missing from the GL 4.0 loader
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+UploadSlot::UploadSlot() : buffer(0), memory(nullptr), fence(0), state(SLOT_UNMAPPED)
+	{}
+
+PixelUploader::PixelUploader() : slotBytes(0), persistent(false)
+	{}
+
+static bool HasExtension(const char *name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++) {
+		const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+		if (extension && strcmp(extension, name) == 0) return true;
+	}
+	return false;
+}
+
+// glBufferStorage from the context, or null when it cannot map persistently
+static BufferStorageProc LoadBufferStorage()
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major * 10 + minor < 44 && !HasExtension("GL_ARB_buffer_storage")) return nullptr;
+
+	BufferStorageProc bufferStorage = (BufferStorageProc)glfwGetProcAddress("glBufferStorage");
+	if (!bufferStorage) bufferStorage = (BufferStorageProc)glfwGetProcAddress("glBufferStorageARB");
+	return bufferStorage;
+}
+
+// maps an unmapped slot for writing (buffer bound to GL_PIXEL_UNPACK_BUFFER)
+static void MapSlot(PixelUploader *uploader, UploadSlot *slot)
+{
+	slot->memory = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, uploader->slotBytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (slot->memory) slot->state = SLOT_FREE;
+}
+
+bool InitializePixelUploader(PixelUploader *uploader, size_t slotBytes)
+{
+	uploader->slotBytes = slotBytes;
+	BufferStorageProc bufferStorage = LoadBufferStorage();
+	uploader->persistent = bufferStorage != nullptr;
+
+	const GLbitfield persistentFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	for (UploadSlot &slot : uploader->slots) {
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		if (uploader->persistent) {
+			bufferStorage(GL_PIXEL_UNPACK_BUFFER, slotBytes, nullptr, persistentFlags);
+			slot.memory = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotBytes, persistentFlags);
+			if (slot.memory) slot.state = SLOT_FREE;
+		} else {
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, slotBytes, nullptr, GL_STREAM_DRAW);
+			MapSlot(uploader, &slot);
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	cout << "Pixel upload ring: " << UPLOAD_SLOTS << " x " << slotBytes / (1024 * 1024) << " MB, "
+		 << (uploader->persistent ? "persistently mapped" : "mapped per upload") << endl;
+	return !CheckGLErrors("Initializing pixel upload ring: ");
+}
+
+int AcquireUploadSlot(PixelUploader *uploader, size_t bytes, unsigned char **memory)
+{
+	lock_guard<mutex> lock(uploader->mutex);
+	if (bytes > uploader->slotBytes) return -1;
+
+	for (int i = 0; i < UPLOAD_SLOTS; i++) {
+		UploadSlot &slot = uploader->slots[i];
+		if (slot.state == SLOT_FREE) {
+			slot.state = SLOT_CLAIMED;
+			*memory = slot.memory;
+			return i;
+		}
+	}
+	return -1;
+}
+
+void ReleaseUploadSlot(PixelUploader *uploader, int slot)
+{
+	lock_guard<mutex> lock(uploader->mutex);
+	uploader->slots[slot].state = SLOT_FREE;
+}
+
+void BeginSlotUpload(PixelUploader *uploader, int slot)
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploader->slots[slot].buffer);
+	if (!uploader->persistent) {
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		uploader->slots[slot].memory = nullptr;
+	}
+}
+
+void EndSlotUpload(PixelUploader *uploader, int slot)
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	lock_guard<mutex> lock(uploader->mutex);
+	UploadSlot &pending = uploader->slots[slot];
+	pending.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	pending.state = SLOT_PENDING;
+}
+
+void RecycleUploadSlots(PixelUploader *uploader)
+{
+	lock_guard<mutex> lock(uploader->mutex);
+	for (UploadSlot &slot : uploader->slots) {
+		if (slot.state == SLOT_PENDING) {
+			GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+			slot.state = uploader->persistent ? SLOT_FREE : SLOT_UNMAPPED;
+		}
+		if (slot.state == SLOT_UNMAPPED && slot.buffer != 0) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+			MapSlot(uploader, &slot);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+	}
+}
+
+void DestroyPixelUploader(PixelUploader *uploader)
+{
+	for (UploadSlot &slot : uploader->slots) {
+		if (slot.fence) {
+			glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(slot.fence);
+		}
+		if (slot.memory) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		glDeleteBuffers(1, &slot.buffer);
+		slot = UploadSlot();
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
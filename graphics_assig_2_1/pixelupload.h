@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// Texture uploads streamed through a ring of pixel unpack buffers
+//
+// Free slots are always mapped, so the decode threads copy pixels straight
+// into buffer memory. The GL thread then points glTexImage2D at the buffer,
+// which returns without waiting for the copy to the texture, and fences the
+// slot; it becomes free again once the fence has signalled. Where
+// ARB_buffer_storage (GL 4.4) exists the slots stay persistently mapped,
+// otherwise each is unmapped for the upload and mapped again afterwards.
+
+const int UPLOAD_SLOTS = 3;
+
+// big enough for the largest image in res/ as RGBA (2048 x 1536)
+const size_t DEFAULT_UPLOAD_SLOT_BYTES = 16 * 1024 * 1024;
+
+enum UploadSlotState
+{
+	SLOT_FREE,		// mapped, waiting for a decode thread
+	SLOT_CLAIMED,	// being written, or written and waiting for the GL thread
+	SLOT_PENDING,	// upload issued, waiting for the fence
+	SLOT_UNMAPPED	// fence passed but the buffer still needs mapping
+};
+
+struct UploadSlot
+{
+	GLuint buffer;
+	unsigned char *memory;	// mapped pointer while free or claimed
+	GLsync fence;
+	UploadSlotState state;
+
+	// initialize object names to zero (OpenGL reserved value)
+	UploadSlot();
+};
+
+struct PixelUploader
+{
+	UploadSlot slots[UPLOAD_SLOTS];
+	size_t slotBytes;
+	bool persistent;
+	std::mutex mutex;		// guards the slot states
+
+	// initialize to an uploader with no buffers
+	PixelUploader();
+};
+
+// creates and maps the ring; call on the GL thread
+bool InitializePixelUploader(PixelUploader *uploader, size_t slotBytes);
+
+// any thread: claims a free slot that can hold the given number of bytes,
+// returning its index and memory, or -1 if none is free or it is too big
+int AcquireUploadSlot(PixelUploader *uploader, size_t bytes, unsigned char **memory);
+
+// any thread: gives back a claimed slot that was never uploaded from
+void ReleaseUploadSlot(PixelUploader *uploader, int slot);
+
+// GL thread: binds the slot as GL_PIXEL_UNPACK_BUFFER, so texture calls
+// read from it (their data pointer becomes an offset into the slot)
+void BeginSlotUpload(PixelUploader *uploader, int slot);
+
+// GL thread: unbinds the slot and fences it behind the texture calls
+void EndSlotUpload(PixelUploader *uploader, int slot);
+
+// GL thread: frees the slots whose uploads have completed, without waiting
+void RecycleUploadSlots(PixelUploader *uploader);
+
+// deallocate upload-related objects, waiting for uploads in flight
+void DestroyPixelUploader(PixelUploader *uploader);
@@ -0,0 +1,106 @@
+#include "pngstream.h"
+#include "trace.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#ifdef HAVE_LIBPNG
+#include <csetjmp>
+#include <png.h>
+#endif
+
+using namespace std;
+
+bool IsPngPath(const string &path)
+{
+	size_t dot = path.rfind('.');
+	if (dot == string::npos) return false;
+	string extension = path.substr(dot + 1);
+	transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == "png";
+}
+
+#ifdef HAVE_LIBPNG
+
+static void PngError(png_structp png, png_const_charp message)
+{
+	cout << "PNG decode: " << message << endl;
+	longjmp(png_jmpbuf(png), 1);
+}
+
+static void PngWarning(png_structp, png_const_charp)
+	{}
+
+bool StreamPngRows(const char *filename, const function<bool(int width, int height, int components)> &start,
+				   const function<void(int y, const unsigned char *row)> &row)
+{
+	TraceSpan span("stream png rows");
+	FILE *file = fopen(filename, "rb");
+	if (!file) return false;
+
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, PngError, PngWarning);
+	png_infop info = png ? png_create_info_struct(png) : nullptr;
+	if (!info) {
+		png_destroy_read_struct(&png, nullptr, nullptr);
+		fclose(file);
+		return false;
+	}
+
+	// libpng errors jump back here from inside its own calls, never from
+	// the callbacks, so only C frames are skipped
+	vector<unsigned char> strip;
+	vector<png_bytep> rows(PNG_STRIP_ROWS);
+	if (setjmp(png_jmpbuf(png))) {
+		png_destroy_read_struct(&png, &info, nullptr);
+		fclose(file);
+		return false;
+	}
+
+	png_init_io(png, file);
+	png_read_info(png, info);
+	if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) {
+		png_destroy_read_struct(&png, &info, nullptr);
+		fclose(file);
+		return false;
+	}
+
+	// 8 bits per component: palettes and low bit depths expanded, 16 bits
+	// cut down, transparency made an alpha channel
+	png_set_expand(png);
+	png_set_strip_16(png);
+	png_read_update_info(png, info);
+
+	int width = png_get_image_width(png, info);
+	int height = png_get_image_height(png, info);
+	int components = png_get_channels(png, info);
+	if (!start(width, height, components)) {
+		png_destroy_read_struct(&png, &info, nullptr);
+		fclose(file);
+		return false;
+	}
+
+	size_t stride = png_get_rowbytes(png, info);
+	strip.resize(stride * PNG_STRIP_ROWS);
+	for (int i = 0; i < PNG_STRIP_ROWS; i++) rows[i] = &strip[stride * i];
+	for (int top = 0; top < height; top += PNG_STRIP_ROWS) {
+		int count = min(PNG_STRIP_ROWS, height - top);
+		png_read_rows(png, rows.data(), nullptr, count);
+		for (int i = 0; i < count; i++) row(height - 1 - (top + i), rows[i]);
+	}
+
+	png_read_end(png, nullptr);
+	png_destroy_read_struct(&png, &info, nullptr);
+	fclose(file);
+	return true;
+}
+
+#else
+
+bool StreamPngRows(const char *, const function<bool(int width, int height, int components)> &,
+				   const function<void(int y, const unsigned char *row)> &)
+{
+	return false;
+}
+
+#endif
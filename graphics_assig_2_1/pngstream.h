@@ -0,0 +1,28 @@
+#pragma once
+#include <functional>
+#include <string>
+
+// --------------------------------------------------------------------------
+// PNG files decoded a strip of rows at a time with libpng (HAVE_LIBPNG,
+// which CMakeLists.txt defines when it finds libpng; off in the Xcode
+// project), so an image can go from the file straight to where it is
+// needed, e.g. an upload slot or the CPU filter engine, without ever being
+// whole in memory. Rows are handed over with their index
+// counted from the bottom, as DecodePixels() stores them, so putting each
+// at its index flips the image for free. Without libpng, or for interlaced
+// files whose rows are only complete after the last pass, streaming fails
+// and callers decode with stb_image instead.
+
+// rows decoded between calls to the row function
+const int PNG_STRIP_ROWS = 16;
+
+// true if the path names a PNG file
+bool IsPngPath(const std::string &path);
+
+// decodes the file row by row. start is called with the size and 8-bit
+// components (1 to 4) once the header is read, and may return false to
+// stop there; row is then called for every row, top row first, with y
+// counting from the bottom. Returns false if the file cannot be streamed,
+// start declined, or decoding failed part way.
+bool StreamPngRows(const char *filename, const std::function<bool(int width, int height, int components)> &start,
+				   const std::function<void(int y, const unsigned char *row)> &row);
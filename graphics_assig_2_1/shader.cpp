@@ -0,0 +1,108 @@
+#include "shader.h"
+#include "trace.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+// OpenGL shader support functions
+
+// reads a text file with the given name into a string
+string LoadSource(const string &filename)
+{
+    string source;
+    
+    ifstream input(filename.c_str());
+    if (input) {
+        copy(istreambuf_iterator<char>(input),
+             istreambuf_iterator<char>(),
+             back_inserter(source));
+        input.close();
+    }
+    else {
+        cout << "ERROR: Could not load shader source from file "
+        << filename << endl;
+    }
+    
+    return source;
+}
+
+// returns the source with the given #define lines inserted after its
+// #version line, for compiling specialized variants of one shader
+string DefineSource(const string &source, const string &defines)
+{
+    // #version must stay the first directive, so the defines go right after it
+    size_t version = source.find("#version");
+    size_t lineEnd = version == string::npos ? string::npos : source.find('\n', version);
+    if (lineEnd == string::npos) {
+        return defines + source;
+    }
+    
+    string result = source;
+    result.insert(lineEnd + 1, defines);
+    return result;
+}
+
+// creates and returns a shader object compiled from the given source
+GLuint CompileShader(GLenum shaderType, const string &source)
+{
+    TraceSpan span("compile shader");
+    
+    // allocate shader object name
+    GLuint shaderObject = glCreateShader(shaderType);
+    
+    // try compiling the source as a shader of the given type
+    const GLchar *source_ptr = source.c_str();
+    glShaderSource(shaderObject, 1, &source_ptr, 0);
+    glCompileShader(shaderObject);
+    
+    // retrieve compile status
+    GLint status;
+    glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &status);
+    if (status == GL_FALSE)
+    {
+        GLint length;
+        glGetShaderiv(shaderObject, GL_INFO_LOG_LENGTH, &length);
+        string info(length, ' ');
+        glGetShaderInfoLog(shaderObject, info.length(), &length, &info[0]);
+        cout << "ERROR compiling shader:" << endl << endl;
+        cout << source << endl;
+        cout << info << endl;
+    }
+    
+    return shaderObject;
+}
+
+// creates and returns a program object linked from vertex and fragment shaders
+GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader)
+{
+    TraceSpan span("link program");
+    
+    // allocate program object name
+    GLuint programObject = glCreateProgram();
+    
+    // attach provided shader objects to this program
+    if (vertexShader)   glAttachShader(programObject, vertexShader);
+    if (fragmentShader) glAttachShader(programObject, fragmentShader);
+    
+    // try linking the program with given attachments
+    glLinkProgram(programObject);
+    
+    // retrieve link status
+    GLint status;
+    glGetProgramiv(programObject, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE)
+    {
+        GLint length;
+        glGetProgramiv(programObject, GL_INFO_LOG_LENGTH, &length);
+        string info(length, ' ');
+        glGetProgramInfoLog(programObject, info.length(), &length, &info[0]);
+        cout << "ERROR linking shader program:" << endl;
+        cout << info << endl;
+    }
+    
+    return programObject;
+}
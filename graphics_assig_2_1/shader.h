@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <glad/glad.h>
+
+// --------------------------------------------------------------------------
+// OpenGL shader support functions
+
+// reads a text file with the given name into a string
+std::string LoadSource(const std::string &filename);
+
+// returns the source with the given #define lines inserted after its
+// #version line, for compiling specialized variants of one shader
+std::string DefineSource(const std::string &source, const std::string &defines);
+
+// creates and returns a shader object compiled from the given source
+GLuint CompileShader(GLenum shaderType, const std::string &source);
+
+// creates and returns a program object linked from vertex and fragment shaders
+GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader);
@@ -0,0 +1,44 @@
+// ==========================================================================
+// Fragment program for one direction of a separable Gaussian blur
+//
+// Each tap after the first covers two neighbouring texels: sampling between
+// them with linear filtering returns their weighted sum in one fetch, so a
+// kernel of radius r costs about r + 1 fetches per pass. Wide blurs read a
+// smaller mipmap level, with sigma and the taps scaled to match.
+// ==========================================================================
+#version 410
+
+#define MAX_TAPS 64
+
+in vec2 TextureCoords;
+
+out vec4 FragmentColour;
+
+uniform sampler2D textureImage_one;
+
+// mipmap level of the source to read
+uniform float sourceLod;
+
+// one texel along the direction of this pass
+uniform vec2 blurStep;
+
+// tap 0 is the centre texel, the rest are mirrored on both sides
+uniform int tapCount;
+uniform float tapOffsets[MAX_TAPS];
+uniform float tapWeights[MAX_TAPS];
+
+// 1 on the last pass, which writes an opaque image like the old gauss()
+uniform float opaque;
+
+void main(void)
+{
+    vec4 sum = textureLod(textureImage_one, TextureCoords, sourceLod) * tapWeights[0];
+    
+    for (int i = 1; i < tapCount; i++) {
+        vec2 offset = blurStep * tapOffsets[i];
+        sum += (textureLod(textureImage_one, TextureCoords + offset, sourceLod) +
+                textureLod(textureImage_one, TextureCoords - offset, sourceLod)) * tapWeights[i];
+    }
+    
+    FragmentColour = opaque > 0 ? vec4(sum.rgb, 1.0) : sum;
+}
@@ -6,8 +6,6 @@
 // ==========================================================================
 #version 410
 
-#define PI 3.14159265358979
-
 // interpolated colour received from vertex stage
 in vec3 Colour;
 in vec2 TextureCoords;
@@ -17,19 +15,70 @@ out vec4 FragmentColour;
 
 uniform sampler2D textureImage_one;
 
-uniform vec3 luminanceValues;
-uniform float adjustBrightness;
-uniform float doSobel;
-uniform float doUnSharp;
-uniform float horSobel;
-uniform float doGauss;
-uniform float gaussVal;
+// every effect is compiled into its own program: the host inserts one of
+// EFFECT_LUMINANCE, EFFECT_BRIGHTNESS, EFFECT_SOBEL (with SOBEL_HORIZONTAL
+// for the horizontal kernel) or EFFECT_UNSHARP after the #version line, and
+// with none of them the program just displays the texture. TILED_TEXTURE
+// may be added to any of them to read a tiled image instead.
+
+// the Gaussian blur is not done here: it runs beforehand as two separable
+// passes of blur.glsl and the plain program displays the result
+
+// effect settings shared by every variant, uploaded by the host only when
+// they change
+layout(std140) uniform FilterUniforms
+{
+    vec3 luminanceValues;
+    float adjustBrightness;
+    float doSobel;
+    float horSobel;
+    float doUnSharp;
+    float doGauss;
+    float gaussVal;
+    float imageWidth;
+    float imageHeight;
+};
+
+#if defined(TILED_TEXTURE)
+// images too big for one texture are drawn from tiles (see tiledtexture.h):
+// textureImage_one is then the atlas of resident tiles, TILE_SIZE texels
+// square with a TILE_GUTTER border, and the page table has one texel per
+// tile of the full-size image giving the atlas page and the level of the
+// tile that covers it
+uniform sampler2D pageTable;
 
-uniform float imageHeight;
-uniform float imageWidth;
+// level the tiles were chosen for, so the kernels step over its texels
+uniform float tileLevel;
+
+vec4 Sample(vec2 coords)
+{
+    vec2 imageSize = vec2(imageWidth, imageHeight);
+    vec2 texel = clamp(coords * imageSize, vec2(0.0), imageSize - 0.5);
+    vec4 entry = floor(texelFetch(pageTable, ivec2(texel / TILE_CONTENT), 0) * 255.0 + 0.5);
+    
+    // position in the tile, in texels of the level it is from
+    float scale = exp2(entry.b);
+    vec2 levelTexel = clamp(texel / scale, vec2(0.5), ceil(imageSize / scale) - 0.5);
+    vec2 local = levelTexel - floor(texel / scale / TILE_CONTENT) * TILE_CONTENT;
+    
+    vec2 atlasTexel = entry.rg * TILE_SIZE + TILE_GUTTER + local;
+    return texture(textureImage_one, atlasTexel / vec2(textureSize(textureImage_one, 0)));
+}
+#else
+vec4 Sample(vec2 coords)
+{
+    return texture(textureImage_one, coords);
+}
+#endif
 
+#if defined(EFFECT_SOBEL) || defined(EFFECT_UNSHARP)
+#if defined(TILED_TEXTURE)
+float step_w = exp2(tileLevel)/imageWidth;
+float step_h = exp2(tileLevel)/imageHeight;
+#else
 float step_w = 1.0/imageWidth;
 float step_h = 1.0/imageHeight;
+#endif
 
 vec2 regOffset[9];
 float regKernel[9];
@@ -49,58 +98,52 @@ void setUpOffset()
     regOffset[8] = vec2(step_w, step_h);
 }
 
-vec4 unSharpen()
+vec4 convolve()
 {
-    vec4 unsharpened = vec4(0.0);
+    vec4 result = vec4(0.0);
+    
+    for( int i = 0; i < 9; i++ )
+    {
+        vec4 tmp = Sample(TextureCoords.st + regOffset[i]);
+        result += tmp * regKernel[i];
+    }
     
+    return result;
+}
+#endif
+
+#if defined(EFFECT_UNSHARP)
+vec4 unSharpen()
+{
     // kernel for unsharpening
     regKernel[0] = 0.0;       regKernel[1] = -1.0;       regKernel[2] = 0.0;
     regKernel[3] = -1.0;      regKernel[4] = 5.0;        regKernel[5] = -1.0;
     regKernel[6] = 0.0;       regKernel[7] = -1.0;       regKernel[8] = 0.0;
     
-    for( int i = 0; i < 9; i++ )
-    {
-        vec4 tmp = texture(textureImage_one, TextureCoords.st + regOffset[i]);
-        unsharpened += tmp * regKernel[i];
-    }
-    
-    return unsharpened;
+    return convolve();
 }
+#endif
 
+#if defined(EFFECT_SOBEL)
 vec4 sobel()
 {
-    vec4 sobelRes = vec4(0.0);
-    
-    if (horSobel > 0) {
-        
-        // kernel for vertical sobel
-        regKernel[0] = -1.0;    regKernel[1] = -2.0;    regKernel[2] = -1.0;
-        regKernel[3] = 0.0;     regKernel[4] = 0.0;     regKernel[5] = 0.0;
-        regKernel[6] = 1.0;     regKernel[7] = 2.0;     regKernel[8] = 1.0;
-        
-        for( int i = 0; i < 9; i++ )
-        {
-            vec4 tmp = texture(textureImage_one, TextureCoords.st + regOffset[i]);
-            sobelRes += tmp * regKernel[i];
-        }
-        
-    } else {
-        
-        // kernel horizontal sobel
-        regKernel[0] = 1.0;       regKernel[1] = 0.0;       regKernel[2] = -1.0;
-        regKernel[3] = 2.0;       regKernel[4] = 0.0;       regKernel[5] = -2.0;
-        regKernel[6] = 1.0;       regKernel[7] = 0.0;       regKernel[8] = -1.0;
-        
-        for( int i = 0; i < 9; i++ )
-        {
-            vec4 tmp = texture(textureImage_one, TextureCoords.st + regOffset[i]);
-            sobelRes += tmp * regKernel[i];
-        }
-    }
-    
-    return sobelRes;
+#if defined(SOBEL_HORIZONTAL)
+    // kernel for vertical sobel
+    regKernel[0] = -1.0;    regKernel[1] = -2.0;    regKernel[2] = -1.0;
+    regKernel[3] = 0.0;     regKernel[4] = 0.0;     regKernel[5] = 0.0;
+    regKernel[6] = 1.0;     regKernel[7] = 2.0;     regKernel[8] = 1.0;
+#else
+    // kernel horizontal sobel
+    regKernel[0] = 1.0;       regKernel[1] = 0.0;       regKernel[2] = -1.0;
+    regKernel[3] = 2.0;       regKernel[4] = 0.0;       regKernel[5] = -2.0;
+    regKernel[6] = 1.0;       regKernel[7] = 0.0;       regKernel[8] = -1.0;
+#endif
+    
+    return convolve();
 }
+#endif
 
+#if defined(EFFECT_BRIGHTNESS)
 vec4 brightness(vec4 newColour)
 {
     float inRed = newColour.r;
@@ -113,7 +156,9 @@ vec4 brightness(vec4 newColour)
     
     return newColour;
 }
+#endif
 
+#if defined(EFFECT_LUMINANCE)
 vec4 luminance(vec4 newColour)
 {
     float luminanceIs = newColour.r * luminanceValues.r + newColour.g * luminanceValues.g + newColour.b * luminanceValues.b;
@@ -124,47 +169,21 @@ vec4 luminance(vec4 newColour)
     
     return newColour;
 }
-
-vec4 gauss()
-{
-    vec2 size = vec2(textureSize(textureImage_one, 0));
-    int r = int(ceil(gaussVal - 0.5));
-    
-    vec3 gaussRes = vec3(0, 0, 0);
-    float k = 0.9342 / (r * r);
-    
-    for (int y = -r; y <= r; y++) {
-        
-        for (int x = -r; x <= r; x++) {
-            
-            float d = length(vec2(x, y));
-            if (d >= r) {
-                continue;
-            }
-            float weight = k * (cos(PI * d/r) + 1) / 2;
-            gaussRes += textureLod(textureImage_one, TextureCoords.xy + vec2(x,y)/size, 0.0).rgb * weight;
-        }
-    }
-    return vec4(gaussRes, 1.0);
-}
+#endif
 
 void main(void)
 {
-    vec4 newColour = texture(textureImage_one, TextureCoords);
-    
+#if defined(EFFECT_LUMINANCE)
+    FragmentColour = luminance(Sample(TextureCoords));
+#elif defined(EFFECT_BRIGHTNESS)
+    FragmentColour = brightness(Sample(TextureCoords));
+#elif defined(EFFECT_SOBEL)
     setUpOffset();
-    
-    if (luminanceValues.r != 1) {
-        newColour = luminance(newColour);
-    } else if (adjustBrightness > 0) {
-        newColour = brightness(newColour);
-    } else if (doSobel > 0) {
-        newColour = sobel();
-    } else if (doUnSharp > 0) {
-        newColour = unSharpen();
-    } else if (doGauss > 0) {
-        newColour = gauss();
-    }
-    
-    FragmentColour = newColour;
+    FragmentColour = sobel();
+#elif defined(EFFECT_UNSHARP)
+    setUpOffset();
+    FragmentColour = unSharpen();
+#else
+    FragmentColour = Sample(TextureCoords);
+#endif
 }
@@ -0,0 +1,17 @@
+// ==========================================================================
+// Vertex program covering the whole render target with one triangle
+//
+// Used by the offscreen filter passes, which run at image resolution and
+// need no vertex buffers (draw 3 vertices with an empty vertex array).
+// ==========================================================================
+#version 410
+
+out vec2 TextureCoords;
+
+void main()
+{
+    // vertices (-1,-1), (3,-1), (-1,3) cover the viewport
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    TextureCoords = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+// --------------------------------------------------------------------------
+// Four-lane float helpers for the CPU filters. One RGBA pixel fills one
+// register: SSE on x86, NEON on ARM, plain floats everywhere else.
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+
+typedef __m128 Pixel;
+
+inline Pixel LoadPixel(const float *p) { return _mm_loadu_ps(p); }
+inline void StorePixel(float *p, Pixel v) { _mm_storeu_ps(p, v); }
+inline Pixel SplatPixel(float s) { return _mm_set1_ps(s); }
+inline Pixel SetPixel(float r, float g, float b, float a) { return _mm_setr_ps(r, g, b, a); }
+inline Pixel AddPixel(Pixel a, Pixel b) { return _mm_add_ps(a, b); }
+inline Pixel SubPixel(Pixel a, Pixel b) { return _mm_sub_ps(a, b); }
+inline Pixel MulPixel(Pixel a, Pixel b) { return _mm_mul_ps(a, b); }
+inline Pixel MulAddPixel(Pixel acc, Pixel a, Pixel b) { return _mm_add_ps(acc, _mm_mul_ps(a, b)); }
+inline Pixel ClampPixel(Pixel v) { return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f)); }
+
+// r*w.r + g*w.g + b*w.b broadcast to all four lanes (w.a must be 0)
+inline Pixel Dot3Pixel(Pixel v, Pixel w)
+{
+	Pixel m = _mm_mul_ps(v, w);
+	m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// red, green and blue from rgb with the alpha of a
+inline Pixel KeepAlpha(Pixel rgb, Pixel a)
+{
+	const Pixel mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	return _mm_or_ps(_mm_and_ps(mask, rgb), _mm_andnot_ps(mask, a));
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+
+typedef float32x4_t Pixel;
+
+inline Pixel LoadPixel(const float *p) { return vld1q_f32(p); }
+inline void StorePixel(float *p, Pixel v) { vst1q_f32(p, v); }
+inline Pixel SplatPixel(float s) { return vdupq_n_f32(s); }
+inline Pixel SetPixel(float r, float g, float b, float a) { const float v[4] = { r, g, b, a }; return vld1q_f32(v); }
+inline Pixel AddPixel(Pixel a, Pixel b) { return vaddq_f32(a, b); }
+inline Pixel SubPixel(Pixel a, Pixel b) { return vsubq_f32(a, b); }
+inline Pixel MulPixel(Pixel a, Pixel b) { return vmulq_f32(a, b); }
+inline Pixel MulAddPixel(Pixel acc, Pixel a, Pixel b) { return vmlaq_f32(acc, a, b); }
+inline Pixel ClampPixel(Pixel v) { return vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f)); }
+
+// r*w.r + g*w.g + b*w.b broadcast to all four lanes (w.a must be 0)
+inline Pixel Dot3Pixel(Pixel v, Pixel w) { return vdupq_n_f32(vaddvq_f32(vmulq_f32(v, w))); }
+
+// red, green and blue from rgb with the alpha of a
+inline Pixel KeepAlpha(Pixel rgb, Pixel a) { return vsetq_lane_f32(vgetq_lane_f32(a, 3), rgb, 3); }
+
+#else
+
+struct Pixel
+{
+	float v[4];
+};
+
+inline Pixel LoadPixel(const float *p) { Pixel r = { { p[0], p[1], p[2], p[3] } }; return r; }
+inline void StorePixel(float *p, Pixel v) { for (int i = 0; i < 4; i++) p[i] = v.v[i]; }
+inline Pixel SplatPixel(float s) { Pixel r = { { s, s, s, s } }; return r; }
+inline Pixel SetPixel(float r, float g, float b, float a) { Pixel p = { { r, g, b, a } }; return p; }
+inline Pixel AddPixel(Pixel a, Pixel b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+inline Pixel SubPixel(Pixel a, Pixel b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+inline Pixel MulPixel(Pixel a, Pixel b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+inline Pixel MulAddPixel(Pixel acc, Pixel a, Pixel b) { for (int i = 0; i < 4; i++) acc.v[i] += a.v[i] * b.v[i]; return acc; }
+inline Pixel ClampPixel(Pixel v) { for (int i = 0; i < 4; i++) v.v[i] = v.v[i] < 0.0f ? 0.0f : (v.v[i] > 1.0f ? 1.0f : v.v[i]); return v; }
+
+// r*w.r + g*w.g + b*w.b broadcast to all four lanes (w.a must be 0)
+inline Pixel Dot3Pixel(Pixel v, Pixel w) { return SplatPixel(v.v[0] * w.v[0] + v.v[1] * w.v[1] + v.v[2] * w.v[2]); }
+
+// red, green and blue from rgb with the alpha of a
+inline Pixel KeepAlpha(Pixel rgb, Pixel a) { rgb.v[3] = a.v[3]; return rgb; }
+
+#endif
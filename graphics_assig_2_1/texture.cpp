@@ -1,8 +1,12 @@
 #include "texture.h"
+#include "trace.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <sys/mman.h>
 
 using namespace std;
 
@@ -31,63 +35,142 @@ bool CheckGLErrors(const char* errorLocation)
 	return error;
 }
 
-MyTexture::MyTexture() : textureID(0), target(0), width(0), height(0)
+MyTexture::MyTexture() : textureID(0), target(0), width(0), height(0), levels(1)
 	{}
 
 
-bool InitializeTexture(MyTexture* texture, const char* filename, GLuint target)
+MyPixels::MyPixels() : data(nullptr), width(0), height(0), components(0), mapping(nullptr), mappedBytes(0)
+	{}
+
+bool DecodePixels(MyPixels *pixels, const char *filename)
 {
-	int numComponents;
+	TraceSpan span("stbi_load");
 	stbi_set_flip_vertically_on_load(true);
-	unsigned char *data = stbi_load(filename, &texture->width, &texture->height, &numComponents, 0);
-	if (data != nullptr)
+	pixels->data = stbi_load(filename, &pixels->width, &pixels->height, &pixels->components, 0);
+	return pixels->data != nullptr;
+}
+
+bool ReadImageSize(const char *filename, int *width, int *height)
+{
+	int components = 0;
+	return stbi_info(filename, width, height, &components) != 0;
+}
+
+void ReducePixels(const MyPixels &pixels, int scale, MyPixels *reduced)
+{
+	int width = (pixels.width + scale - 1) / scale;
+	int height = (pixels.height + scale - 1) / scale;
+	int components = pixels.components;
+	unsigned char *data = (unsigned char *)malloc((size_t)width * height * components);
+	for (int y = 0; y < height; y++) {
+		int y1 = min((y + 1) * scale, pixels.height);
+		for (int x = 0; x < width; x++) {
+			int x1 = min((x + 1) * scale, pixels.width);
+			for (int c = 0; c < components; c++) {
+				unsigned sum = 0, count = 0;
+				for (int sy = y * scale; sy < y1; sy++) {
+					const unsigned char *row = pixels.data + (size_t)sy * pixels.width * components + c;
+					for (int sx = x * scale; sx < x1; sx++, count++) sum += row[(size_t)sx * components];
+				}
+				data[((size_t)y * width + x) * components + c] = (unsigned char)((sum + count / 2) / count);
+			}
+		}
+	}
+
+	reduced->data = data;
+	reduced->width = width;
+	reduced->height = height;
+	reduced->components = components;
+}
+
+// release the decoded pixel memory, or unmap it
+void DestroyPixels(MyPixels *pixels)
+{
+	if (pixels->mapping) {
+		munmap(pixels->mapping, pixels->mappedBytes);
+	} else {
+		stbi_image_free(pixels->data);
+	}
+	*pixels = MyPixels();
+}
+
+bool InitializeTexture(MyTexture* texture, const char* filename, GLuint target)
+{
+	MyPixels pixels;
+	if (DecodePixels(&pixels, filename))
+	{
+		bool result = InitializeTexture(texture, pixels, target);
+		DestroyPixels(&pixels);
+
+		if (!result) cout << "Loading texture: " << filename << endl;
+		return result;
+	}
+
+	cout << "Could not load " << filename << endl;
+	return false;
+}
+
+bool InitializeTexture(MyTexture* texture, const MyPixels &pixels, GLuint target)
+{
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);		//Set alignment to be 1
+
+	texture->target = target;
+	texture->width = pixels.width;
+	texture->height = pixels.height;
+	glGenTextures(1, &texture->textureID);
+	glBindTexture(texture->target, texture->textureID);
+	GLuint format = GL_RGB;
+	switch(pixels.components)
+	{
+		case 4:
+			format = GL_RGBA;
+			break;
+		case 3:
+			format = GL_RGB;
+			break;
+		case 2:
+			format = GL_RG;
+			break;
+		case 1:
+			format = GL_RED;
+			break;
+		default:
+			cout << "Invalid Texture Format" << endl;
+			break;
+	};
 	{
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);		//Set alignment to be 1
-
-		texture->target = target;
-		glGenTextures(1, &texture->textureID);
-		glBindTexture(texture->target, texture->textureID);
-		GLuint format = GL_RGB;
-		switch(numComponents)
-		{
-			case 4:
-				format = GL_RGBA;
-				break;
-			case 3:
-				format = GL_RGB;
-				break;
-			case 2:
-				format = GL_RG;
-				break;
-			case 1:
-				format = GL_RED;
-				break;
-			default:
-				cout << "Invalid Texture Format" << endl;
-				break;
-		};
-		glTexImage2D(texture->target, 0, format, texture->width, texture->height, 0, format, GL_UNSIGNED_BYTE, data);
-
-		// Note: Only wrapping modes supported for GL_TEXTURE_RECTANGLE when defining
-		// GL_TEXTURE_WRAP are GL_CLAMP_TO_EDGE or GL_CLAMP_TO_BORDER
-		glTexParameteri(texture->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(texture->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(texture->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		// Clean up
-		glBindTexture(texture->target, 0);
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);	//Return to default alignment
-		stbi_image_free(data);
-
-		return !CheckGLErrors( (string("Loading texture: ")+filename).c_str() );
+		TraceSpan span("glTexImage2D");
+		glTexImage2D(texture->target, 0, format, texture->width, texture->height, 0, format, GL_UNSIGNED_BYTE, pixels.data);
 	}
-    else
-    {
-        cout << "failed to load image" << endl;
-    }
 
-	return true; //error
+	// Note: Only wrapping modes supported for GL_TEXTURE_RECTANGLE when defining
+	// GL_TEXTURE_WRAP are GL_CLAMP_TO_EDGE or GL_CLAMP_TO_BORDER
+	glTexParameteri(texture->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(texture->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(texture->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// Clean up
+	glBindTexture(texture->target, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);	//Return to default alignment
+
+	// zoomed-out views read the smaller levels instead of aliasing
+	// (rectangle textures cannot have any)
+	if (texture->target == GL_TEXTURE_2D) GenerateMipmaps(texture);
+
+	return !CheckGLErrors("Uploading texture: ");
+}
+
+void GenerateMipmaps(MyTexture *texture)
+{
+	int levels = 1;
+	while ((max(texture->width, texture->height) >> levels) > 0) levels++;
+	texture->levels = levels;
+
+	glBindTexture(texture->target, texture->textureID);
+	glGenerateMipmap(texture->target);
+	glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glBindTexture(texture->target, 0);
 }
 
 // deallocate texture-related objects
@@ -97,3 +180,48 @@ void DestroyTexture(MyTexture *texture)
 	glDeleteTextures(1, &texture->textureID);
 }
 
+MyRenderTarget::MyRenderTarget() : framebuffer(0)
+	{}
+
+bool InitializeRenderTarget(MyRenderTarget *target, int width, int height, GLenum internalFormat)
+{
+	if (target->framebuffer != 0 && target->texture.width == width && target->texture.height == height)
+		return true;
+	DestroyRenderTarget(target);
+
+	MyTexture *texture = &target->texture;
+	texture->target = GL_TEXTURE_2D;
+	texture->width = width;
+	texture->height = height;
+	texture->levels = 1;
+	glGenTextures(1, &texture->textureID);
+	glBindTexture(texture->target, texture->textureID);
+	glTexImage2D(texture->target, 0, internalFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(texture->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(texture->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(texture->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(texture->target, 0);
+
+	glGenFramebuffers(1, &target->framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture->target, texture->textureID, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		cout << "Render target " << width << " x " << height << " is incomplete" << endl;
+		return false;
+	}
+	return !CheckGLErrors("Creating render target: ");
+}
+
+// deallocate render target related objects
+void DestroyRenderTarget(MyRenderTarget *target)
+{
+	if (target->framebuffer != 0) {
+		glDeleteFramebuffers(1, &target->framebuffer);
+		DestroyTexture(&target->texture);
+	}
+	*target = MyRenderTarget();
+}
@@ -1,7 +1,11 @@
 #pragma once
+#include <cstddef>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+// reports any pending OpenGL errors, prefixed with the given location
+bool CheckGLErrors(const char* errorLocation);
+
 // --------------------------------------------------------------------------
 // Functions to set up OpenGL buffers for storing textures
 
@@ -11,12 +15,64 @@ struct MyTexture
 	GLuint target;
 	int width;
 	int height;
+	int levels;		// mipmap levels, 1 when only the base image exists
 
 	// initialize object names to zero (OpenGL reserved value)
 	MyTexture();
 };
 
+// pixels decoded from an image file, bottom row first as glTexImage2D expects
+struct MyPixels
+{
+	unsigned char *data;
+	int width;
+	int height;
+	int components;
+	void *mapping;		// when the pixels are mapped from a file (pixelcache.h)
+	size_t mappedBytes;
+
+	// initialize to an empty image
+	MyPixels();
+};
+
+bool DecodePixels(MyPixels *pixels, const char *filename);
+
+// reads only the size from the file's header
+bool ReadImageSize(const char *filename, int *width, int *height);
+
+// the mean of each scale x scale block of the pixels, rounding the size up
+// (the blocks at the right and top edges are smaller), into memory
+// DestroyPixels() releases
+void ReducePixels(const MyPixels &pixels, int scale, MyPixels *reduced);
+
+// release the decoded pixel memory, or unmap it
+void DestroyPixels(MyPixels *pixels);
+
+// decodes the image and uploads it, false if it cannot be read
 bool InitializeTexture(MyTexture* texture, const char* filename, GLuint target = GL_TEXTURE_2D);
+bool InitializeTexture(MyTexture* texture, const MyPixels &pixels, GLuint target = GL_TEXTURE_2D);
+
+// rebuilds the mipmap levels from the base image and switches the texture to
+// trilinear filtering; textures from InitializeTexture() already have them
+void GenerateMipmaps(MyTexture *texture);
 
 // deallocate texture-related objects
-void DestroyTexture(MyTexture *texture);
\ No newline at end of file
+void DestroyTexture(MyTexture *texture);
+
+// --------------------------------------------------------------------------
+// Framebuffer objects rendering into a texture
+
+struct MyRenderTarget
+{
+	GLuint framebuffer;
+	MyTexture texture;
+
+	// initialize object names to zero (OpenGL reserved value)
+	MyRenderTarget();
+};
+
+// (re)allocates the target at the given size; does nothing if it already matches
+bool InitializeRenderTarget(MyRenderTarget *target, int width, int height, GLenum internalFormat = GL_RGBA16F);
+
+// deallocate render target related objects
+void DestroyRenderTarget(MyRenderTarget *target);
\ No newline at end of file
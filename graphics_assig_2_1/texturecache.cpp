@@ -0,0 +1,98 @@
+#include "texturecache.h"
+#include <iostream>
+
+using namespace std;
+
+TextureCache::TextureCache() : budget(DEFAULT_TEXTURE_CACHE_BYTES), bytes(0), hits(0), misses(0), evictions(0)
+	{}
+
+void InitializeTextureCache(TextureCache *cache, size_t budget)
+{
+	DestroyTextureCache(cache);
+	cache->budget = budget;
+}
+
+// deletes least recently used textures until the cache fits its budget,
+// keeping at least the most recent one
+static void EvictTextures(TextureCache *cache)
+{
+	while (cache->bytes > cache->budget && cache->textures.size() > 1) {
+		CachedTexture &oldest = cache->textures.back();
+		DestroyTexture(&oldest.texture);
+		cache->bytes -= oldest.bytes;
+		cache->index.erase(oldest.path);
+		cache->textures.pop_back();
+		cache->evictions++;
+	}
+}
+
+const MyTexture *FindCachedTexture(TextureCache *cache, const string &path, int *scale)
+{
+	auto found = cache->index.find(path);
+	if (found == cache->index.end()) {
+		cache->misses++;
+		return nullptr;
+	}
+
+	cache->hits++;
+	cache->textures.splice(cache->textures.begin(), cache->textures, found->second);
+	if (scale) *scale = found->second->scale;
+	return &found->second->texture;
+}
+
+const MyTexture *AddCachedTexture(TextureCache *cache, const string &path, const MyPixels &pixels, int scale)
+{
+	CachedTexture entry;
+	entry.path = path;
+	entry.scale = scale;
+	// RGBA plus a third again for the mipmaps
+	entry.bytes = (size_t)pixels.width * pixels.height * 4 * 4 / 3;
+	if (!InitializeTexture(&entry.texture, pixels)) {
+		cout << "Loading texture: " << path << endl;
+		DestroyTexture(&entry.texture);
+		return nullptr;
+	}
+
+	// replaces any texture already cached for the path
+	auto found = cache->index.find(path);
+	if (found != cache->index.end()) {
+		DestroyTexture(&found->second->texture);
+		cache->bytes -= found->second->bytes;
+		cache->textures.erase(found->second);
+	}
+
+	cache->textures.push_front(entry);
+	cache->index[path] = cache->textures.begin();
+	cache->bytes += entry.bytes;
+	EvictTextures(cache);
+	return &cache->textures.front().texture;
+}
+
+const MyTexture *LoadCachedTexture(TextureCache *cache, const string &path)
+{
+	const MyTexture *texture = FindCachedTexture(cache, path);
+	if (texture) return texture;
+
+	MyPixels pixels;
+	if (!DecodePixels(&pixels, path.c_str())) {
+		return nullptr;
+	}
+	texture = AddCachedTexture(cache, path, pixels);
+	DestroyPixels(&pixels);
+	return texture;
+}
+
+void PrintTextureCacheStats(const TextureCache &cache)
+{
+	cout << "Texture cache: " << cache.hits << " hits, " << cache.misses << " misses, "
+		 << cache.evictions << " evictions, " << cache.textures.size() << " textures in "
+		 << cache.bytes / (1024 * 1024) << " of " << cache.budget / (1024 * 1024) << " MB" << endl;
+}
+
+void DestroyTextureCache(TextureCache *cache)
+{
+	for (CachedTexture &entry : cache->textures) DestroyTexture(&entry.texture);
+	cache->textures.clear();
+	cache->index.clear();
+	cache->bytes = 0;
+}
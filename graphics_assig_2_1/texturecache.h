@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// Textures of recently viewed images, kept in GPU memory so switching back
+// to one needs no decode or upload. When the textures outgrow the byte
+// budget the least recently used ones are deleted.
+
+const size_t DEFAULT_TEXTURE_CACHE_BYTES = 256 * 1024 * 1024;
+
+struct CachedTexture
+{
+	std::string path;
+	MyTexture texture;
+	size_t bytes;		// estimated GPU memory, 4 bytes per texel
+	int scale;			// 1 / scale of the image's size, for previews
+};
+
+struct TextureCache
+{
+	size_t budget;		// bytes the textures may occupy
+	size_t bytes;		// bytes they occupy now
+	std::list<CachedTexture> textures;		// most recently used first
+	std::unordered_map<std::string, std::list<CachedTexture>::iterator> index;
+
+	unsigned hits;
+	unsigned misses;
+	unsigned evictions;
+
+	// initialize to an empty cache with the default budget
+	TextureCache();
+};
+
+void InitializeTextureCache(TextureCache *cache, size_t budget);
+
+// returns the texture of the image if it is cached (counting a hit) or
+// nullptr (counting a miss)
+const MyTexture *FindCachedTexture(TextureCache *cache, const std::string &path, int *scale = nullptr);
+
+// uploads decoded pixels as the texture of the image, returning nullptr if
+// that fails; the same eviction rules as LoadCachedTexture() apply. A scale
+// above 1 marks them as a reduced preview, which the full-size pixels
+// replace when they are added.
+const MyTexture *AddCachedTexture(TextureCache *cache, const std::string &path, const MyPixels &pixels,
+								  int scale = 1);
+
+// returns the texture of the image, decoding and uploading it only if it is
+// not cached, or nullptr if it cannot be loaded. The texture stays valid
+// until a later call evicts it; the one just returned never is, even when
+// it alone exceeds the budget.
+const MyTexture *LoadCachedTexture(TextureCache *cache, const std::string &path);
+
+// prints the hit, miss and eviction counts
+void PrintTextureCacheStats(const TextureCache &cache);
+
+// deletes every cached texture
+void DestroyTextureCache(TextureCache *cache);
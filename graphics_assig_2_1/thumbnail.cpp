@@ -0,0 +1,193 @@
+#include "thumbnail.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <stb/stb_image.h>
+
+using namespace std;
+
+// an EXIF block is a single marker segment, so never more than this
+static const size_t MAX_EXIF_BYTES = 65536 + 4;
+
+// EXIF tags of the IFD describing the thumbnail
+static const uint16_t TAG_THUMBNAIL_OFFSET = 0x0201;
+static const uint16_t TAG_THUMBNAIL_BYTES = 0x0202;
+
+static int ThumbnailScale(int width, int height)
+{
+	return max((max(width, height) + THUMBNAIL_SIZE - 1) / THUMBNAIL_SIZE, 1);
+}
+
+void MakeThumbnail(const MyPixels &pixels, MyPixels *thumbnail)
+{
+	ReducePixels(pixels, ThumbnailScale(pixels.width, pixels.height), thumbnail);
+}
+
+void ReadBackThumbnail(ThumbnailCache *cache, const string &path, const MyTexture &texture)
+{
+	if (FindThumbnail(*cache, path)) return;
+	for (const ThumbnailReadback &readback : cache->readbacks) {
+		if (readback.path == path) return;
+	}
+
+	int level = 0;
+	while ((max(texture.width, texture.height) >> level) > THUMBNAIL_SIZE) level++;
+	if (level >= texture.levels) return;
+
+	ThumbnailReadback readback;
+	readback.path = path;
+	readback.width = max(texture.width >> level, 1);
+	readback.height = max(texture.height >> level, 1);
+
+	// read as many components as were uploaded
+	GLint green = 0, blue = 0, alpha = 0;
+	glBindTexture(texture.target, texture.textureID);
+	glGetTexLevelParameteriv(texture.target, level, GL_TEXTURE_GREEN_SIZE, &green);
+	glGetTexLevelParameteriv(texture.target, level, GL_TEXTURE_BLUE_SIZE, &blue);
+	glGetTexLevelParameteriv(texture.target, level, GL_TEXTURE_ALPHA_SIZE, &alpha);
+	readback.components = alpha > 0 ? 4 : blue > 0 ? 3 : green > 0 ? 2 : 1;
+	static const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+
+	glGenBuffers(1, &readback.buffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)readback.width * readback.height * readback.components, nullptr,
+		GL_STREAM_READ);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(texture.target, level, formats[readback.components - 1], GL_UNSIGNED_BYTE, nullptr);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindTexture(texture.target, 0);
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	cache->readbacks.push_back(readback);
+}
+
+static void DestroyReadback(ThumbnailReadback *readback)
+{
+	glDeleteSync(readback->fence);
+	glDeleteBuffers(1, &readback->buffer);
+}
+
+void CollectThumbnails(ThumbnailCache *cache)
+{
+	for (size_t i = 0; i < cache->readbacks.size();) {
+		ThumbnailReadback &readback = cache->readbacks[i];
+		GLenum status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+			i++;
+			continue;
+		}
+
+		// rows come back bottom first, as MyPixels keeps them
+		size_t bytes = (size_t)readback.width * readback.height * readback.components;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+		const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+		if (mapped) {
+			MyPixels thumbnail;
+			thumbnail.width = readback.width;
+			thumbnail.height = readback.height;
+			thumbnail.components = readback.components;
+			thumbnail.data = (unsigned char *)malloc(bytes);
+			memcpy(thumbnail.data, mapped, bytes);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			AddThumbnail(cache, readback.path, &thumbnail);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		DestroyReadback(&readback);
+		cache->readbacks.erase(cache->readbacks.begin() + i);
+	}
+}
+
+void AddThumbnail(ThumbnailCache *cache, const string &path, MyPixels *thumbnail)
+{
+	MyPixels &entry = cache->thumbnails[path];
+	DestroyPixels(&entry);
+	entry = *thumbnail;
+	*thumbnail = MyPixels();
+}
+
+const MyPixels *FindThumbnail(const ThumbnailCache &cache, const string &path)
+{
+	auto found = cache.thumbnails.find(path);
+	return found == cache.thumbnails.end() ? nullptr : &found->second;
+}
+
+// the TIFF structure inside an EXIF block
+struct TiffBlock
+{
+	const unsigned char *data;
+	size_t size;
+	bool bigEndian;
+};
+
+// reads an integer in the block's byte order, or 0 past its end
+static uint32_t ReadTiff(const TiffBlock &tiff, size_t offset, int bytes)
+{
+	if (offset + bytes > tiff.size) return 0;
+	uint32_t value = 0;
+	for (int i = 0; i < bytes; i++) {
+		int shift = tiff.bigEndian ? 8 * (bytes - 1 - i) : 8 * i;
+		value |= (uint32_t)tiff.data[offset + i] << shift;
+	}
+	return value;
+}
+
+bool ReadExifThumbnail(MyPixels *thumbnail, const char *filename)
+{
+	ifstream file(filename, ios::binary);
+	unsigned char marker[4];
+	if (!file.read((char *)marker, 2) || marker[0] != 0xFF || marker[1] != 0xD8) return false;
+
+	// the EXIF block is an APP1 segment among the first few after SOI
+	vector<unsigned char> exif;
+	while (file.read((char *)marker, 4) && marker[0] == 0xFF) {
+		size_t length = ((size_t)marker[2] << 8 | marker[3]);
+		if (length < 2) return false;
+		if (marker[1] == 0xDA || marker[1] == 0xD9) return false;		// image data: no EXIF
+		if (marker[1] != 0xE1) {
+			file.seekg(length - 2, ios::cur);
+			continue;
+		}
+		exif.resize(min(length - 2, MAX_EXIF_BYTES));
+		if (!file.read((char *)exif.data(), exif.size())) return false;
+		if (exif.size() > 6 && memcmp(exif.data(), "Exif\0\0", 6) == 0) break;
+		exif.clear();
+	}
+	if (exif.size() < 14) return false;
+
+	// the TIFF header, whose offsets everything else is relative to
+	TiffBlock tiff = { exif.data() + 6, exif.size() - 6, exif[6] == 'M' };
+	if (ReadTiff(tiff, 2, 2) != 42) return false;
+
+	// IFD0 describes the image, the IFD after it the thumbnail
+	uint32_t ifd0 = ReadTiff(tiff, 4, 4);
+	uint32_t ifd1 = ReadTiff(tiff, ifd0 + 2 + 12 * ReadTiff(tiff, ifd0, 2), 4);
+	if (ifd1 == 0) return false;
+
+	uint32_t offset = 0, bytes = 0;
+	uint32_t entries = ReadTiff(tiff, ifd1, 2);
+	for (uint32_t i = 0; i < entries; i++) {
+		size_t entry = ifd1 + 2 + 12 * i;
+		uint16_t tag = (uint16_t)ReadTiff(tiff, entry, 2);
+		if (tag == TAG_THUMBNAIL_OFFSET) offset = ReadTiff(tiff, entry + 8, 4);
+		if (tag == TAG_THUMBNAIL_BYTES) bytes = ReadTiff(tiff, entry + 8, 4);
+	}
+	if (bytes == 0 || (size_t)offset + bytes > tiff.size) return false;
+
+	int components = 0;
+	stbi_set_flip_vertically_on_load(true);
+	thumbnail->data = stbi_load_from_memory(tiff.data + offset, (int)bytes, &thumbnail->width, &thumbnail->height,
+											&components, 0);
+	thumbnail->components = components;
+	return thumbnail->data != nullptr;
+}
+
+void DestroyThumbnailCache(ThumbnailCache *cache)
+{
+	for (auto &entry : cache->thumbnails) DestroyPixels(&entry.second);
+	cache->thumbnails.clear();
+	for (ThumbnailReadback &readback : cache->readbacks) DestroyReadback(&readback);
+	cache->readbacks.clear();
+}
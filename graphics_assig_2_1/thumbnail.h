@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// Small versions of images to show the moment one is selected, while the
+// full image decodes: the thumbnail of an image decoded before, or the
+// thumbnail a camera embedded in a JPEG's EXIF data.
+
+// the longest side of the thumbnails made from decoded images
+const int THUMBNAIL_SIZE = 128;
+
+// a thumbnail on its way back from a mipmap level of an uploaded texture,
+// through a pixel pack buffer so neither the upload nor the read is waited for
+struct ThumbnailReadback
+{
+	std::string path;
+	GLuint buffer;
+	GLsync fence;
+	int width;
+	int height;
+	int components;
+};
+
+// thumbnails of the images decoded so far, about 64 KB each at most
+struct ThumbnailCache
+{
+	std::unordered_map<std::string, MyPixels> thumbnails;
+	std::vector<ThumbnailReadback> readbacks;
+};
+
+// reduces decoded pixels to at most THUMBNAIL_SIZE on their longest side
+void MakeThumbnail(const MyPixels &pixels, MyPixels *thumbnail);
+
+// GL thread: starts reading the first mipmap level of the texture that is at
+// most THUMBNAIL_SIZE on its longest side, unless the path has a thumbnail or
+// one on its way; the texture may be deleted straight after. Textures without
+// mipmaps get no thumbnail.
+void ReadBackThumbnail(ThumbnailCache *cache, const std::string &path, const MyTexture &texture);
+
+// GL thread: adds the thumbnails whose reads the GPU has finished
+void CollectThumbnails(ThumbnailCache *cache);
+
+// takes over the thumbnail, replacing any kept for the path
+void AddThumbnail(ThumbnailCache *cache, const std::string &path, MyPixels *thumbnail);
+
+// the thumbnail of the image, or nullptr
+const MyPixels *FindThumbnail(const ThumbnailCache &cache, const std::string &path);
+
+// decodes the thumbnail in a JPEG file's EXIF data, if it has one, bottom
+// row first; reads no more of the file than the EXIF block
+bool ReadExifThumbnail(MyPixels *thumbnail, const char *filename);
+
+void DestroyThumbnailCache(ThumbnailCache *cache);
@@ -0,0 +1,347 @@
+#include "tiledtexture.h"
+#include "filters.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+TileLevel::TileLevel() : width(0), height(0), data(nullptr)
+	{}
+
+TilePage::TilePage() : level(-1), x(0), y(0), lastUsed(0)
+	{}
+
+TiledTexture::TiledTexture() : width(0), height(0), components(0), pagesPerSide(0), displayLevel(0),
+	frame(0), uploads(0), evictions(0)
+	{}
+
+int MaxTextureSize()
+{
+	GLint size = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &size);
+	return size;
+}
+
+static uint64_t TileKey(int level, int x, int y)
+{
+	return ((uint64_t)level << 48) | ((uint64_t)y << 24) | (uint64_t)x;
+}
+
+static int TileCount(int size)
+{
+	return (size + TILE_CONTENT - 1) / TILE_CONTENT;
+}
+
+// the next level of the pyramid: 2 x 2 means, repeating the last row or
+// column when the size is odd
+static void DownsampleLevel(const TileLevel &src, int components, TileLevel *dst)
+{
+	dst->width = (src.width + 1) / 2;
+	dst->height = (src.height + 1) / 2;
+	dst->pixels.resize((size_t)dst->width * dst->height * components);
+	dst->data = dst->pixels.data();
+
+	ParallelRows(dst->height, [&](int first, int end) {
+		for (int y = first; y < end; y++) {
+			const unsigned char *top = src.data + (size_t)(2 * y) * src.width * components;
+			const unsigned char *bottom = src.data + (size_t)min(2 * y + 1, src.height - 1) * src.width * components;
+			unsigned char *out = &dst->pixels[(size_t)y * dst->width * components];
+			for (int x = 0; x < dst->width; x++) {
+				int left = 2 * x * components;
+				int right = min(2 * x + 1, src.width - 1) * components;
+				for (int c = 0; c < components; c++) {
+					out[x * components + c] = (unsigned char)
+						((top[left + c] + top[right + c] + bottom[left + c] + bottom[right + c] + 2) / 4);
+				}
+			}
+		}
+	});
+}
+
+void BuildTileLevels(vector<TileLevel> *levels, int components)
+{
+	while (levels->back().width > TILE_CONTENT || levels->back().height > TILE_CONTENT) {
+		levels->push_back(TileLevel());
+		DownsampleLevel((*levels)[levels->size() - 2], components, &levels->back());
+	}
+}
+
+void CopyTile(const TileLevel &level, int components, int tileX, int tileY, vector<unsigned char> *tile)
+{
+	tile->resize(TILE_SIZE * TILE_SIZE * components);
+	for (int y = 0; y < TILE_SIZE; y++) {
+		int sourceY = min(max(tileY * TILE_CONTENT - TILE_GUTTER + y, 0), level.height - 1);
+		const unsigned char *row = level.data + (size_t)sourceY * level.width * components;
+		unsigned char *out = &(*tile)[y * TILE_SIZE * components];
+		for (int x = 0; x < TILE_SIZE; x++) {
+			int sourceX = min(max(tileX * TILE_CONTENT - TILE_GUTTER + x, 0), level.width - 1);
+			for (int c = 0; c < components; c++) out[x * components + c] = row[sourceX * components + c];
+		}
+	}
+}
+
+// a tile as RGBA, filling in missing channels the way the texture unit does
+static void ExpandTile(const vector<unsigned char> &tile, int components, vector<unsigned char> *rgba)
+{
+	rgba->resize(TILE_SIZE * TILE_SIZE * 4);
+	for (int i = 0; i < TILE_SIZE * TILE_SIZE; i++) {
+		const unsigned char *in = &tile[i * components];
+		unsigned char *out = &(*rgba)[i * 4];
+		out[0] = in[0];
+		out[1] = components > 1 ? in[1] : 0;
+		out[2] = components > 2 ? in[2] : 0;
+		out[3] = components > 3 ? in[3] : 255;
+	}
+}
+
+// the tile's texels from the levels in memory or from the pyramid file
+// (black if the file cannot be read)
+static void ReadTile(TiledTexture *tiled, int level, int tileX, int tileY, vector<unsigned char> *tile)
+{
+	if (!IsOpen(tiled->pyramid)) {
+		CopyTile(tiled->levels[level], tiled->components, tileX, tileY, tile);
+	} else if (!ReadPyramidTile(&tiled->pyramid, level, tileX, tileY, tile)) {
+		tile->assign(TILE_SIZE * TILE_SIZE * tiled->components, 0);
+	}
+}
+
+static bool CreateTexture(MyTexture *texture, int width, int height, GLint filter)
+{
+	texture->target = GL_TEXTURE_2D;
+	texture->width = width;
+	texture->height = height;
+	texture->levels = 1;
+	glGenTextures(1, &texture->textureID);
+	glBindTexture(texture->target, texture->textureID);
+	glTexImage2D(texture->target, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(texture->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(texture->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(texture->target, GL_TEXTURE_MAG_FILTER, filter);
+	glBindTexture(texture->target, 0);
+	return !CheckGLErrors("Creating tiled texture: ");
+}
+
+// puts a tile into a free page, or the page least recently needed before
+// this frame; returns false when every page is needed by this frame
+static bool UploadTile(TiledTexture *tiled, int level, int tileX, int tileY)
+{
+	int best = -1;
+	for (int i = 0; i < (int)tiled->pages.size(); i++) {
+		const TilePage &page = tiled->pages[i];
+		if (page.level < 0) {
+			best = i;
+			break;
+		}
+		// the coarsest tile is what everything else falls back to
+		bool pinned = page.level == (int)tiled->levels.size() - 1;
+		if (!pinned && page.lastUsed != tiled->frame &&
+			(best < 0 || page.lastUsed < tiled->pages[best].lastUsed)) {
+			best = i;
+		}
+	}
+	if (best < 0) return false;
+
+	TilePage &page = tiled->pages[best];
+	if (page.level >= 0) {
+		tiled->resident.erase(TileKey(page.level, page.x, page.y));
+		tiled->evictions++;
+	}
+	page.level = level;
+	page.x = tileX;
+	page.y = tileY;
+	page.lastUsed = tiled->frame;
+	tiled->resident[TileKey(level, tileX, tileY)] = best;
+
+	TraceSpan span("upload tile");
+	vector<unsigned char> tile, rgba;
+	ReadTile(tiled, level, tileX, tileY, &tile);
+	ExpandTile(tile, tiled->components, &rgba);
+	glBindTexture(GL_TEXTURE_2D, tiled->atlas.textureID);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, (best % tiled->pagesPerSide) * TILE_SIZE, (best / tiled->pagesPerSide) * TILE_SIZE,
+					TILE_SIZE, TILE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+	tiled->uploads++;
+	return true;
+}
+
+// points every tile of the full-size image at the page holding it at the
+// display level, or at the nearest coarser level that is resident
+static void UpdatePageTable(TiledTexture *tiled)
+{
+	int width = tiled->pageTable.width;
+	int height = tiled->pageTable.height;
+	int level = tiled->displayLevel;
+	int span = 1 << level;
+	vector<unsigned char> entries((size_t)width * height * 4);
+
+	for (int tileY = 0; tileY * span < height; tileY++) {
+		for (int tileX = 0; tileX * span < width; tileX++) {
+			int page = 0, found = (int)tiled->levels.size() - 1;
+			for (int l = level; l < (int)tiled->levels.size(); l++) {
+				auto entry = tiled->resident.find(TileKey(l, tileX >> (l - level), tileY >> (l - level)));
+				if (entry != tiled->resident.end()) {
+					page = entry->second;
+					found = l;
+					break;
+				}
+			}
+
+			for (int y = tileY * span; y < min((tileY + 1) * span, height); y++) {
+				for (int x = tileX * span; x < min((tileX + 1) * span, width); x++) {
+					unsigned char *texel = &entries[((size_t)y * width + x) * 4];
+					texel[0] = (unsigned char)(page % tiled->pagesPerSide);
+					texel[1] = (unsigned char)(page / tiled->pagesPerSide);
+					texel[2] = (unsigned char)found;
+					texel[3] = 255;
+				}
+			}
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, tiled->pageTable.textureID);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, entries.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// creates the atlas and page table for the levels, and uploads the
+// coarsest level
+static bool CreateTiledTextures(TiledTexture *tiled)
+{
+	int atlasSize = min(MaxTextureSize(), MAX_TILE_ATLAS_SIZE);
+	tiled->pagesPerSide = atlasSize / TILE_SIZE;
+	tiled->pages.assign(tiled->pagesPerSide * tiled->pagesPerSide, TilePage());
+	if (!CreateTexture(&tiled->atlas, tiled->pagesPerSide * TILE_SIZE, tiled->pagesPerSide * TILE_SIZE, GL_LINEAR) ||
+		!CreateTexture(&tiled->pageTable, TileCount(tiled->width), TileCount(tiled->height), GL_NEAREST)) {
+		return false;
+	}
+
+	tiled->displayLevel = (int)tiled->levels.size() - 1;
+	UploadTile(tiled, tiled->displayLevel, 0, 0);
+	UpdatePageTable(tiled);
+
+	cout << "Tiled image " << tiled->width << " x " << tiled->height << ": " << tiled->levels.size() << " levels, "
+		 << tiled->pageTable.width << " x " << tiled->pageTable.height << " tiles at full size, "
+		 << tiled->pages.size() << " atlas pages" << endl;
+	return !CheckGLErrors("Initializing tiled texture: ");
+}
+
+bool InitializeTiledTexture(TiledTexture *tiled, MyPixels *pixels)
+{
+	tiled->width = pixels->width;
+	tiled->height = pixels->height;
+	tiled->components = pixels->components;
+	tiled->base = *pixels;
+	*pixels = MyPixels();
+
+	tiled->levels.resize(1);
+	tiled->levels[0].width = tiled->width;
+	tiled->levels[0].height = tiled->height;
+	tiled->levels[0].data = tiled->base.data;
+	BuildTileLevels(&tiled->levels, tiled->components);
+	return CreateTiledTextures(tiled);
+}
+
+bool InitializeTiledTexture(TiledTexture *tiled, const char *pyramidPath)
+{
+	if (!OpenTilePyramid(&tiled->pyramid, pyramidPath)) return false;
+
+	tiled->width = tiled->pyramid.width;
+	tiled->height = tiled->pyramid.height;
+	tiled->components = tiled->pyramid.components;
+	tiled->levels.resize(tiled->pyramid.levels.size());
+	for (size_t i = 0; i < tiled->levels.size(); i++) {
+		tiled->levels[i].width = tiled->pyramid.levels[i].width;
+		tiled->levels[i].height = tiled->pyramid.levels[i].height;
+	}
+	return CreateTiledTextures(tiled);
+}
+
+bool IsTiled(const TiledTexture &tiled)
+{
+	return !tiled.levels.empty();
+}
+
+int TileLevelForScale(const TiledTexture &tiled, float texelsPerPixel)
+{
+	int level = 0;
+	while (level + 1 < (int)tiled.levels.size() && (float)(2 << level) <= texelsPerPixel) level++;
+	return level;
+}
+
+bool UpdateTileResidency(TiledTexture *tiled, const float region[4], int level, int maxUploads)
+{
+	tiled->frame++;
+	bool changed = level != tiled->displayLevel;
+	tiled->displayLevel = level;
+
+	// tiles of the level under the region; level texels are 2^level
+	// full-size texels wide
+	float texels = (float)(TILE_CONTENT << level);
+	int lastX = TileCount(tiled->levels[level].width) - 1;
+	int lastY = TileCount(tiled->levels[level].height) - 1;
+	int firstX = min(max((int)(region[0] * tiled->width / texels), 0), lastX);
+	int firstY = min(max((int)(region[1] * tiled->height / texels), 0), lastY);
+	lastX = min(max((int)(region[2] * tiled->width / texels), 0), lastX);
+	lastY = min(max((int)(region[3] * tiled->height / texels), 0), lastY);
+
+	vector<pair<int, int>> missing;
+	for (int y = firstY; y <= lastY; y++) {
+		for (int x = firstX; x <= lastX; x++) {
+			auto entry = tiled->resident.find(TileKey(level, x, y));
+			if (entry != tiled->resident.end()) {
+				tiled->pages[entry->second].lastUsed = tiled->frame;
+			} else {
+				missing.push_back(make_pair(x, y));
+			}
+		}
+	}
+
+	// the tiles nearest the middle of the window first
+	float middleX = (firstX + lastX) * 0.5f, middleY = (firstY + lastY) * 0.5f;
+	sort(missing.begin(), missing.end(), [&](const pair<int, int> &a, const pair<int, int> &b) {
+		return fabs(a.first - middleX) + fabs(a.second - middleY) < fabs(b.first - middleX) + fabs(b.second - middleY);
+	});
+
+	int uploaded = 0;
+	bool full = false;
+	for (const pair<int, int> &tile : missing) {
+		if (uploaded == maxUploads) break;
+		if (!UploadTile(tiled, level, tile.first, tile.second)) {
+			full = true;
+			break;
+		}
+		uploaded++;
+	}
+
+	if (changed || uploaded > 0) UpdatePageTable(tiled);
+	CheckGLErrors("Updating tiled texture: ");
+	return full || uploaded == (int)missing.size();
+}
+
+void BindPageTable(const TiledTexture &tiled, GLuint unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, tiled.pageTable.textureID);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void PrintTiledTextureStats(const TiledTexture &tiled)
+{
+	cout << "Tiled texture: " << tiled.uploads << " tiles uploaded, " << tiled.evictions << " evicted, "
+		 << tiled.resident.size() << " of " << tiled.pages.size() << " pages in use" << endl;
+	if (IsOpen(tiled.pyramid)) {
+		cout << "Tile pyramid: " << tiled.pyramid.tilesRead << " tiles read in " << tiled.pyramid.readMs << " ms" << endl;
+	}
+}
+
+void DestroyTiledTexture(TiledTexture *tiled)
+{
+	if (tiled->atlas.textureID != 0) DestroyTexture(&tiled->atlas);
+	if (tiled->pageTable.textureID != 0) DestroyTexture(&tiled->pageTable);
+	DestroyPixels(&tiled->base);
+	CloseTilePyramid(&tiled->pyramid);
+	*tiled = TiledTexture();
+}
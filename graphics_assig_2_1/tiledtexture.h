@@ -0,0 +1,120 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "texture.h"
+#include "tilepyramid.h"
+
+// --------------------------------------------------------------------------
+// Images too big for one texture, drawn from fixed-size tiles
+//
+// The decoded image and a pyramid of half-size levels stay in client memory,
+// or the tiles are read from a tile pyramid file (tilepyramid.h). Only the
+// tiles of the level matching the zoom that are inside the window
+// are uploaded, each into a page of one atlas texture, with a gutter of its
+// neighbours' texels around it so linear filtering across tile borders is
+// seamless. A page table texture, one texel per tile of the full-size image,
+// tells fragment.glsl (compiled with TILED_TEXTURE) which page holds the
+// tile at each point, or the nearest coarser tile while that one is missing.
+
+// a tile in the atlas: TILE_CONTENT image texels plus a gutter on each side
+const int TILE_SIZE = 256;
+const int TILE_GUTTER = 1;
+const int TILE_CONTENT = TILE_SIZE - 2 * TILE_GUTTER;
+
+// largest atlas side, in texels (256 pages of 256 x 256 texels, 64 MB)
+const int MAX_TILE_ATLAS_SIZE = 4096;
+
+// one level of the pyramid; texel (x, y) of level L is the mean of the
+// 2^L x 2^L texels of the full-size image from (x 2^L, y 2^L), so the
+// width is the full width / 2^L rounded up
+struct TileLevel
+{
+	int width;
+	int height;
+	const unsigned char *data;			// components bytes per texel, bottom row first
+	std::vector<unsigned char> pixels;	// storage for all levels but the first
+
+	// initialize to an empty level
+	TileLevel();
+};
+
+// a page of the atlas and the tile it holds
+struct TilePage
+{
+	int level;			// -1 while the page is free
+	int x;
+	int y;
+	unsigned lastUsed;	// frame the tile was last needed in
+
+	// initialize to a free page
+	TilePage();
+};
+
+struct TiledTexture
+{
+	int width;
+	int height;
+	int components;
+	MyPixels base;					// the decoded image, level 0
+	std::vector<TileLevel> levels;	// up to one that fits in a single tile
+	TilePyramid pyramid;			// open instead when reading from a file;
+									// the levels then have no data
+
+	MyTexture atlas;
+	MyTexture pageTable;			// RGBA8: page x, page y, level, 1
+	int pagesPerSide;
+	std::vector<TilePage> pages;
+	std::unordered_map<uint64_t, int> resident;		// tile key to page
+
+	int displayLevel;
+	unsigned frame;
+	unsigned uploads;
+	unsigned evictions;
+
+	// initialize to an empty texture
+	TiledTexture();
+};
+
+// the largest texture side the context allows
+int MaxTextureSize();
+
+// takes over the decoded pixels (which are released with the texture),
+// builds the coarser levels, creates the atlas and page table, and uploads
+// the coarsest level so something can be drawn straight away
+bool InitializeTiledTexture(TiledTexture *tiled, MyPixels *pixels);
+
+// the same for a tile pyramid file, which is kept open to read tiles from
+bool InitializeTiledTexture(TiledTexture *tiled, const char *pyramidPath);
+
+// builds the levels after levels[0], each half the size of the one before
+// (rounded up), until one fits in a single tile
+void BuildTileLevels(std::vector<TileLevel> *levels, int components);
+
+// copies a tile of a level with its gutter, clamping at the image edges:
+// TILE_SIZE x TILE_SIZE texels with the level's components, bottom row first
+void CopyTile(const TileLevel &level, int components, int tileX, int tileY, std::vector<unsigned char> *tile);
+
+// true if an image has been loaded
+bool IsTiled(const TiledTexture &tiled);
+
+// the level to draw at when one window pixel covers the given number of
+// full-size texels: the finest whose texels are no smaller than a pixel
+int TileLevelForScale(const TiledTexture &tiled, float texelsPerPixel);
+
+// makes the tiles of the given level that overlap region (u0, v0, u1, v1 in
+// texture coordinates) resident, uploading at most maxUploads of them and
+// evicting the least recently needed pages when the atlas is full, then
+// updates the page table. Returns false while tiles are still missing that
+// could be uploaded, in which case the page table points at coarser ones
+// and the caller should draw and call again.
+bool UpdateTileResidency(TiledTexture *tiled, const float region[4], int level, int maxUploads);
+
+// binds the page table to the given texture unit for fragment.glsl
+void BindPageTable(const TiledTexture &tiled, GLuint unit);
+
+// prints the number of tiles uploaded and evicted
+void PrintTiledTextureStats(const TiledTexture &tiled);
+
+// deallocate the textures and the pyramid
+void DestroyTiledTexture(TiledTexture *tiled);
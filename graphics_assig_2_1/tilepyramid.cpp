@@ -0,0 +1,291 @@
+#include "tilepyramid.h"
+#include "filters.h"
+#include "tiledtexture.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image_write.h>
+#include <stb/stb_image.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+static const char PYRAMID_MAGIC[4] = { 'T', 'P', 'Y', 'R' };
+static const uint32_t PYRAMID_VERSION = 1;
+static const int JPEG_QUALITY = 90;
+
+TilePyramid::TilePyramid() : width(0), height(0), components(0), codec(TILE_CODEC_RAW), tilesRead(0), readMs(0)
+	{}
+
+static double ElapsedMs(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+bool ParseTileCodec(const string &name, TileCodec *codec)
+{
+	if (name == "raw") {
+		*codec = TILE_CODEC_RAW;
+	} else if (name == "png") {
+		*codec = TILE_CODEC_PNG;
+	} else if (name == "jpeg" || name == "jpg") {
+		*codec = TILE_CODEC_JPEG;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool IsTilePyramidPath(const string &path)
+{
+	return path.size() > 4 && path.compare(path.size() - 4, 4, ".pyr") == 0;
+}
+
+static void AppendBytes(void *context, void *data, int size)
+{
+	vector<unsigned char> *bytes = (vector<unsigned char> *)context;
+	bytes->insert(bytes->end(), (unsigned char *)data, (unsigned char *)data + size);
+}
+
+// compresses a tile, bottom row first as CopyTile() makes it
+static void EncodeTile(const vector<unsigned char> &tile, int components, TileCodec codec, vector<unsigned char> *bytes)
+{
+	bytes->clear();
+	switch (codec) {
+		case TILE_CODEC_PNG:
+			stbi_write_png_to_func(AppendBytes, bytes, TILE_SIZE, TILE_SIZE, components, tile.data(), TILE_SIZE * components);
+			break;
+		case TILE_CODEC_JPEG:
+			stbi_write_jpg_to_func(AppendBytes, bytes, TILE_SIZE, TILE_SIZE, components, tile.data(), JPEG_QUALITY);
+			break;
+		default:
+			*bytes = tile;
+			break;
+	}
+}
+
+bool WriteTilePyramid(const char *imagePath, const char *pyramidPath, TileCodec codec)
+{
+	auto start = chrono::steady_clock::now();
+	MyPixels pixels;
+	if (!DecodePixels(&pixels, imagePath)) {
+		cout << "Could not decode " << imagePath << endl;
+		return false;
+	}
+	double decodeMs = ElapsedMs(start);
+
+	if (codec == TILE_CODEC_JPEG && (pixels.components == 2 || pixels.components == 4)) {
+		cout << "JPEG tiles cannot keep the alpha channel, using PNG" << endl;
+		codec = TILE_CODEC_PNG;
+	}
+
+	vector<TileLevel> levels(1);
+	levels[0].width = pixels.width;
+	levels[0].height = pixels.height;
+	levels[0].data = pixels.data;
+	BuildTileLevels(&levels, pixels.components);
+
+	ofstream output(pyramidPath, ios::binary);
+	if (!output) {
+		cout << "Could not write " << pyramidPath << endl;
+		DestroyPixels(&pixels);
+		return false;
+	}
+
+	PyramidHeader header;
+	memcpy(header.magic, PYRAMID_MAGIC, sizeof(header.magic));
+	header.version = PYRAMID_VERSION;
+	header.width = pixels.width;
+	header.height = pixels.height;
+	header.components = pixels.components;
+	header.tileSize = TILE_SIZE;
+	header.tileGutter = TILE_GUTTER;
+	header.codec = codec;
+	header.levelCount = (uint32_t)levels.size();
+	output.write((const char *)&header, sizeof(header));
+
+	size_t tileCount = 0;
+	for (const TileLevel &level : levels) {
+		uint32_t size[2] = { (uint32_t)level.width, (uint32_t)level.height };
+		output.write((const char *)size, sizeof(size));
+		tileCount += (size_t)((level.width + TILE_CONTENT - 1) / TILE_CONTENT) * ((level.height + TILE_CONTENT - 1) / TILE_CONTENT);
+	}
+
+	// the index is filled in once the tiles are written
+	vector<PyramidTile> index(tileCount);
+	streamoff indexOffset = output.tellp();
+	output.write((const char *)index.data(), index.size() * sizeof(PyramidTile));
+
+	// PNG and JPEG tiles are written top row first, as image files are
+	stbi_flip_vertically_on_write(1);
+
+	// a row of tiles at a time, compressed in parallel
+	size_t tile = 0;
+	for (const TileLevel &level : levels) {
+		int tilesX = (level.width + TILE_CONTENT - 1) / TILE_CONTENT;
+		int tilesY = (level.height + TILE_CONTENT - 1) / TILE_CONTENT;
+		vector<vector<unsigned char>> encoded(tilesX);
+		for (int y = 0; y < tilesY; y++) {
+			ParallelRows(tilesX, [&](int first, int end) {
+				vector<unsigned char> texels;
+				for (int x = first; x < end; x++) {
+					CopyTile(level, pixels.components, x, y, &texels);
+					EncodeTile(texels, pixels.components, codec, &encoded[x]);
+				}
+			});
+			for (int x = 0; x < tilesX; x++, tile++) {
+				index[tile].offset = (uint64_t)output.tellp();
+				index[tile].bytes = (uint32_t)encoded[x].size();
+				index[tile].reserved = 0;
+				output.write((const char *)encoded[x].data(), encoded[x].size());
+			}
+		}
+	}
+	uint64_t fileBytes = (uint64_t)output.tellp();
+
+	output.seekp(indexOffset);
+	output.write((const char *)index.data(), index.size() * sizeof(PyramidTile));
+	bool written = (bool)output;
+	output.close();
+	DestroyPixels(&pixels);
+
+	if (!written) {
+		cout << "Could not write " << pyramidPath << endl;
+		return false;
+	}
+	cout << "Wrote " << pyramidPath << ": " << header.width << " x " << header.height << ", " << levels.size()
+		 << " levels, " << tileCount << " tiles, " << fileBytes / 1024 << " KB (decoded in " << decodeMs
+		 << " ms, written in " << ElapsedMs(start) - decodeMs << " ms)" << endl;
+	return true;
+}
+
+bool OpenTilePyramid(TilePyramid *pyramid, const char *path)
+{
+	pyramid->file.open(path, ios::binary);
+	PyramidHeader header;
+	if (!pyramid->file.read((char *)&header, sizeof(header)) ||
+		memcmp(header.magic, PYRAMID_MAGIC, sizeof(header.magic)) != 0 || header.version != PYRAMID_VERSION) {
+		cout << path << " is not a tile pyramid" << endl;
+		CloseTilePyramid(pyramid);
+		return false;
+	}
+	if (header.tileSize != TILE_SIZE || header.tileGutter != TILE_GUTTER || header.codec > TILE_CODEC_JPEG ||
+		header.components < 1 || header.components > 4 || header.levelCount < 1 || header.levelCount > 32) {
+		cout << path << " has tiles this program cannot draw" << endl;
+		CloseTilePyramid(pyramid);
+		return false;
+	}
+
+	if (header.width < 1 || header.height < 1) {
+		cout << path << " has an empty image" << endl;
+		CloseTilePyramid(pyramid);
+		return false;
+	}
+
+	pyramid->width = header.width;
+	pyramid->height = header.height;
+	pyramid->components = header.components;
+	pyramid->codec = (TileCodec)header.codec;
+
+	// each level must halve the one before, rounding up, as BuildTileLevels()
+	// makes them, down to a single tile (the page table and the tile that
+	// stays resident both assume one coarsest tile)
+	size_t tileCount = 0;
+	pyramid->levels.resize(header.levelCount);
+	for (uint32_t i = 0; i < header.levelCount; i++) {
+		PyramidLevel &level = pyramid->levels[i];
+		uint32_t size[2] = { 0, 0 };
+		pyramid->file.read((char *)size, sizeof(size));
+		uint64_t expectedWidth = ((uint64_t)header.width + (1ull << i) - 1) >> i;
+		uint64_t expectedHeight = ((uint64_t)header.height + (1ull << i) - 1) >> i;
+		bool last = i + 1 == header.levelCount;
+		bool fits = size[0] <= (uint32_t)TILE_CONTENT && size[1] <= (uint32_t)TILE_CONTENT;
+		if (!pyramid->file || size[0] != expectedWidth || size[1] != expectedHeight || fits != last) {
+			cout << path << " has a malformed level " << i << endl;
+			CloseTilePyramid(pyramid);
+			return false;
+		}
+		level.width = size[0];
+		level.height = size[1];
+		level.tilesX = (level.width + TILE_CONTENT - 1) / TILE_CONTENT;
+		level.tilesY = (level.height + TILE_CONTENT - 1) / TILE_CONTENT;
+		level.firstTile = tileCount;
+		tileCount += (size_t)level.tilesX * level.tilesY;
+	}
+
+	// the index must fit in the file before it is allocated, and every tile
+	// it points to must lie within the file
+	streamoff indexOffset = pyramid->file.tellg();
+	pyramid->file.seekg(0, ios::end);
+	uint64_t fileBytes = (uint64_t)pyramid->file.tellg();
+	pyramid->file.seekg(indexOffset);
+	if (tileCount > (fileBytes - (uint64_t)indexOffset) / sizeof(PyramidTile)) {
+		cout << path << " is truncated" << endl;
+		CloseTilePyramid(pyramid);
+		return false;
+	}
+	pyramid->index.resize(tileCount);
+	pyramid->file.read((char *)pyramid->index.data(), tileCount * sizeof(PyramidTile));
+	if (!pyramid->file) {
+		cout << path << " is truncated" << endl;
+		CloseTilePyramid(pyramid);
+		return false;
+	}
+	for (const PyramidTile &tile : pyramid->index) {
+		if (tile.offset > fileBytes || tile.bytes > fileBytes - tile.offset) {
+			cout << path << " has tiles past the end of the file" << endl;
+			CloseTilePyramid(pyramid);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool IsOpen(const TilePyramid &pyramid)
+{
+	return pyramid.file.is_open();
+}
+
+bool ReadPyramidTile(TilePyramid *pyramid, int level, int tileX, int tileY, vector<unsigned char> *tile)
+{
+	auto start = chrono::steady_clock::now();
+	const PyramidLevel &source = pyramid->levels[level];
+	const PyramidTile &entry = pyramid->index[source.firstTile + (size_t)tileY * source.tilesX + tileX];
+	size_t tileBytes = (size_t)TILE_SIZE * TILE_SIZE * pyramid->components;
+
+	vector<unsigned char> &bytes = pyramid->codec == TILE_CODEC_RAW ? *tile : pyramid->buffer;
+	bytes.resize(entry.bytes);
+	pyramid->file.clear();
+	pyramid->file.seekg((streamoff)entry.offset);
+	if (!pyramid->file.read((char *)bytes.data(), entry.bytes)) {
+		cout << "Could not read tile " << tileX << ", " << tileY << " of level " << level << endl;
+		return false;
+	}
+
+	if (pyramid->codec != TILE_CODEC_RAW) {
+		// flipped on load to bottom row first, like every decode here
+		int width = 0, height = 0, components = 0;
+		stbi_set_flip_vertically_on_load(true);
+		unsigned char *texels = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &width, &height, &components,
+													  pyramid->components);
+		if (!texels || width != TILE_SIZE || height != TILE_SIZE) {
+			cout << "Could not decompress tile " << tileX << ", " << tileY << " of level " << level << endl;
+			stbi_image_free(texels);
+			return false;
+		}
+		tile->assign(texels, texels + tileBytes);
+		stbi_image_free(texels);
+	}
+
+	pyramid->tilesRead++;
+	pyramid->readMs += ElapsedMs(start);
+	return tile->size() == tileBytes;
+}
+
+void CloseTilePyramid(TilePyramid *pyramid)
+{
+	if (pyramid->file.is_open()) pyramid->file.close();
+	pyramid->levels.clear();
+	pyramid->index.clear();
+	pyramid->buffer.clear();
+}
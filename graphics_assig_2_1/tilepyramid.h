@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "texture.h"
+
+// --------------------------------------------------------------------------
+// Tile pyramid files (.pyr): an image stored as the tiles tiledtexture.h
+// draws, for every level of its pyramid, each compressed on its own and
+// found through an index, so a viewer can open a huge image by reading only
+// the tiles of the current view and zoom instead of decoding all of it.
+//
+// Layout, little-endian:
+//   PyramidHeader
+//   levelCount x { uint32 width, uint32 height }
+//   one PyramidTile per tile: level 0 first, bottom row of tiles first
+//   the compressed tiles
+//
+// A tile is TILE_SIZE x TILE_SIZE texels including its gutter, with the
+// image's number of components. PNG and JPEG tiles are ordinary images,
+// top row first.
+
+enum TileCodec
+{
+	TILE_CODEC_RAW,		// uncompressed, the fastest to read
+	TILE_CODEC_PNG,		// lossless
+	TILE_CODEC_JPEG		// lossy, the smallest; not for images with alpha
+};
+
+struct PyramidHeader
+{
+	char magic[4];			// "TPYR"
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t components;
+	uint32_t tileSize;		// TILE_SIZE and TILE_GUTTER when written
+	uint32_t tileGutter;
+	uint32_t codec;
+	uint32_t levelCount;
+};
+
+struct PyramidTile
+{
+	uint64_t offset;		// from the start of the file
+	uint32_t bytes;
+	uint32_t reserved;
+};
+
+struct PyramidLevel
+{
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+	size_t firstTile;		// index of its bottom-left tile
+};
+
+struct TilePyramid
+{
+	std::ifstream file;
+	int width;
+	int height;
+	int components;
+	TileCodec codec;
+	std::vector<PyramidLevel> levels;
+	std::vector<PyramidTile> index;
+	std::vector<unsigned char> buffer;		// compressed bytes of the last tile read
+	unsigned tilesRead;
+	double readMs;			// spent reading and decompressing tiles
+
+	// initialize to a closed pyramid
+	TilePyramid();
+};
+
+// "raw", "png" or "jpeg"
+bool ParseTileCodec(const std::string &name, TileCodec *codec);
+
+// true if the path names a tile pyramid file
+bool IsTilePyramidPath(const std::string &path);
+
+// decodes an image and writes it out as a tile pyramid, printing how long
+// that took and how big the result is
+bool WriteTilePyramid(const char *imagePath, const char *pyramidPath, TileCodec codec);
+
+// reads the header and index; tiles are read on demand
+bool OpenTilePyramid(TilePyramid *pyramid, const char *path);
+
+bool IsOpen(const TilePyramid &pyramid);
+
+// reads and decompresses one tile into TILE_SIZE x TILE_SIZE texels,
+// bottom row first
+bool ReadPyramidTile(TilePyramid *pyramid, int level, int tileX, int tileY, std::vector<unsigned char> *tile);
+
+void CloseTilePyramid(TilePyramid *pyramid);
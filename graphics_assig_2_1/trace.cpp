@@ -0,0 +1,133 @@
+#include "trace.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+atomic<bool> tracingEnabled(false);
+
+struct TraceEvent
+{
+	const char *name;
+	uint64_t start;
+	uint64_t end;
+};
+
+// one thread's spans; the lock is only contended while a trace is written
+struct TraceBuffer
+{
+	int threadId;
+	const char *threadName;
+	mutex lock;
+	vector<TraceEvent> events;
+	uint64_t recorded;		// spans ever recorded, the newest at (recorded - 1) % size
+
+	TraceBuffer(int threadId) : threadId(threadId), threadName(nullptr), events(TRACE_BUFFER_SPANS), recorded(0) {}
+};
+
+// every thread's buffer, kept after the thread exits so its spans are written
+static mutex buffersLock;
+static vector<unique_ptr<TraceBuffer>> buffers;
+static thread_local TraceBuffer *threadBuffer = nullptr;
+static thread_local const char *threadName = nullptr;
+
+static const chrono::steady_clock::time_point traceEpoch = chrono::steady_clock::now();
+
+static TraceBuffer *ThreadBuffer()
+{
+	if (!threadBuffer) {
+		lock_guard<mutex> guard(buffersLock);
+		buffers.emplace_back(new TraceBuffer((int)buffers.size() + 1));
+		threadBuffer = buffers.back().get();
+		threadBuffer->threadName = threadName;
+	}
+	return threadBuffer;
+}
+
+uint64_t TraceNow()
+{
+	return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - traceEpoch).count();
+}
+
+void EnableTracing(bool enable)
+{
+	tracingEnabled.store(enable, memory_order_relaxed);
+}
+
+void RecordSpan(const char *name, uint64_t start, uint64_t end)
+{
+	TraceBuffer *buffer = ThreadBuffer();
+	lock_guard<mutex> guard(buffer->lock);
+	TraceEvent &event = buffer->events[buffer->recorded % TRACE_BUFFER_SPANS];
+	event.name = name;
+	event.start = start;
+	event.end = end;
+	buffer->recorded++;
+}
+
+void SetTraceThreadName(const char *name)
+{
+	// the buffer is only made once the thread records a span
+	threadName = name;
+	if (threadBuffer) {
+		lock_guard<mutex> guard(threadBuffer->lock);
+		threadBuffer->threadName = name;
+	}
+}
+
+static void WriteJsonString(ofstream &file, const char *text)
+{
+	file << '"';
+	for (const char *c = text; *c; c++) {
+		if (*c == '"' || *c == '\\') file << '\\';
+		file << *c;
+	}
+	file << '"';
+}
+
+bool WriteTrace(const char *path)
+{
+	ofstream file(path);
+	if (!file) {
+		cout << "Could not write " << path << endl;
+		return false;
+	}
+
+	// timestamps are in microseconds, with the nanoseconds as decimals
+	int pid = (int)getpid();
+	size_t written = 0;
+	file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" << endl << fixed << setprecision(3);
+	lock_guard<mutex> guard(buffersLock);
+	for (const unique_ptr<TraceBuffer> &buffer : buffers) {
+		lock_guard<mutex> bufferGuard(buffer->lock);
+		if (buffer->threadName) {
+			file << (written++ ? ",\n" : "") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+				 << ",\"tid\":" << buffer->threadId << ",\"args\":{\"name\":";
+			WriteJsonString(file, buffer->threadName);
+			file << "}}";
+		}
+
+		uint64_t first = buffer->recorded > (uint64_t)TRACE_BUFFER_SPANS ? buffer->recorded - TRACE_BUFFER_SPANS : 0;
+		for (uint64_t i = first; i < buffer->recorded; i++) {
+			const TraceEvent &event = buffer->events[i % TRACE_BUFFER_SPANS];
+			file << (written++ ? ",\n" : "") << "{\"name\":";
+			WriteJsonString(file, event.name);
+			file << ",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << buffer->threadId << ",\"ts\":"
+				 << event.start / 1e3 << ",\"dur\":" << (event.end - event.start) / 1e3 << "}";
+		}
+	}
+	file << endl << "]}" << endl;
+
+	if (!file) {
+		cout << "Could not write " << path << endl;
+		return false;
+	}
+	cout << "Wrote " << written << " trace events from " << buffers.size() << " threads to " << path << endl;
+	return true;
+}
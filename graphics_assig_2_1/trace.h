@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// --------------------------------------------------------------------------
+// Lightweight tracing of timed spans, written out as Chrome trace JSON
+// (open it at chrome://tracing or ui.perfetto.dev)
+//
+// Each thread records its spans into a ring buffer of its own, so recording
+// takes no shared lock; the oldest spans are overwritten once a thread has
+// recorded TRACE_BUFFER_SPANS of them. While tracing is off a span only
+// reads one flag, so the spans stay compiled into every build.
+
+// spans each thread keeps, about 1.5 MB per thread that traces
+const int TRACE_BUFFER_SPANS = 65536;
+
+extern std::atomic<bool> tracingEnabled;
+
+inline bool TracingEnabled()
+{
+	return tracingEnabled.load(std::memory_order_relaxed);
+}
+
+// nanoseconds since tracing was started
+uint64_t TraceNow();
+
+// starts or stops recording; spans recorded before stopping are kept
+void EnableTracing(bool enable);
+
+// records a finished span; the name must outlive the trace (a literal)
+void RecordSpan(const char *name, uint64_t start, uint64_t end);
+
+// the name the calling thread is shown under, also a literal
+void SetTraceThreadName(const char *name);
+
+// writes every thread's spans as a Chrome trace JSON file
+bool WriteTrace(const char *path);
+
+// a span from construction to the end of the enclosing scope
+struct TraceSpan
+{
+	const char *name;
+	bool recording;		// false while tracing is off
+	uint64_t start;
+
+	explicit TraceSpan(const char *name) : name(name), recording(TracingEnabled()), start(recording ? TraceNow() : 0) {}
+	~TraceSpan() { if (recording) RecordSpan(name, start, TraceNow()); }
+
+	TraceSpan(const TraceSpan &) = delete;
+	TraceSpan &operator=(const TraceSpan &) = delete;
+};